@@ -0,0 +1,88 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <avr/eeprom.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "driver.h"
+
+// Drawing progress saved in eeprom.
+struct Checkpoint {
+  uint8_t sequence;
+  uint8_t image;  // 1-based menu entry, 0 if there is nothing to resume
+  uint8_t variant;  // of a generator
+  DrawProgress progress;
+  uint8_t checksum;
+};
+
+// Wear-levelled storage of checkpoints in eeprom.
+//
+// Checkpoints are written round-robin into `kSlots` slots, each tagged with a
+// sequence number one higher than the previous one. The valid slot with the
+// highest sequence number holds the current checkpoint. A slot torn by a reset
+// during the write fails the checksum, so the previous one is used instead.
+//
+// kSlots: number of slots, at most 127 so that sequence numbers are ordered.
+template <uint8_t kSlots>
+class CheckpointStore {
+  static_assert(kSlots > 1 && kSlots < 128);
+
+ public:
+  // `slots` is an eeprom pointer.
+  explicit CheckpointStore(Checkpoint* slots) : slots_(slots) {}
+
+  // Finds the current checkpoint. Returns false if there is nothing to resume.
+  bool Load(Checkpoint* checkpoint) {
+    bool found = false;
+    for (uint8_t i = 0; i < kSlots; ++i) {
+      Checkpoint c;
+      eeprom_read_block(&c, &slots_[i], sizeof(Checkpoint));
+      if (c.checksum != Checksum(c)) continue;
+      if (found && static_cast<int8_t>(c.sequence - checkpoint->sequence) < 0) {
+        continue;
+      }
+      *checkpoint = c;
+      current_ = i;
+      found = true;
+    }
+    if (!found) {
+      *checkpoint = Checkpoint{};
+      current_ = kSlots - 1;
+    }
+    sequence_ = checkpoint->sequence;
+    return checkpoint->image != 0;
+  }
+
+  // Writes a new checkpoint into the slot following the current one.
+  void Save(uint8_t image, uint8_t variant, const DrawProgress& progress) {
+    Checkpoint c{static_cast<uint8_t>(sequence_ + 1), image, variant, progress,
+                 0};
+    c.checksum = Checksum(c);
+    current_ = (current_ + 1) % kSlots;
+    sequence_ = c.sequence;
+    eeprom_update_block(&c, &slots_[current_], sizeof(Checkpoint));
+  }
+
+  // Marks that there is nothing to resume.
+  void Clear() {
+    Save(0, 0, DrawProgress{});
+  }
+
+ private:
+  // Neither erased (0xff) nor zeroed slots pass the check.
+  static uint8_t Checksum(const Checkpoint& c) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&c);
+    uint8_t sum = 0xa5;
+    for (uint8_t i = 0; i < offsetof(Checkpoint, checksum); ++i) {
+      sum += p[i];
+    }
+    return sum;
+  }
+
+  Checkpoint* slots_;
+  uint8_t current_ = kSlots - 1;
+  uint8_t sequence_ = 0;
+};
+
+#endif  // CHECKPOINT_H_
@@ -6,6 +6,8 @@
 #include <stdint.h>
 
 #include "motors.h"
+#include "opcodes.h"
+#include "scheduler.h"
 #include "utils.h"
 #include "stl.h"
 
@@ -18,7 +20,206 @@ static_assert(sizeof(DataPoint) == 4);
 
 struct Image {
   uint16_t num_points;
-  const DataPoint* points;  // progmem pointer
+  const DataPoint* points;  // image data pointer
+};
+
+// Placement of image data (Image, DataPoint and image tables).
+//
+// With FLMAP_IMAGES, image data lives in flash section 1 (0x8000 - 0xffff),
+// which NVMCTRL maps into data space at the same addresses. It is read through
+// plain pointers. Otherwise it is in progmem and read with memcpy_P.
+#if FLMAP_IMAGES
+#define IMAGE_DATA __attribute__((section(".flmap1"), used))
+#else
+#define IMAGE_DATA PROGMEM
+#endif
+
+template <typename T>
+inline T ReadImageData(const T* p) {
+#if FLMAP_IMAGES
+  return *p;
+#else
+  T v;
+  memcpy_P(&v, p, sizeof(T));
+  return v;
+#endif
+}
+
+// Source of the points drawn by Driver::DrawImage. Next() returns false at the
+// end. Sources are deterministic, resuming replays them.
+template <typename T>
+concept IsImageSource = requires(T t, DataPoint* p) {
+  { t.Next(p) } -> std::same_as<bool>;
+};
+
+// Reads the points of an Image and executes the opcodes (see opcodes.h) on the
+// way.
+class ImageReader {
+ public:
+  // `image` is an image data pointer, see IMAGE_DATA.
+  explicit ImageReader(const Image* image) : image_(ReadImageData(image)) {}
+
+  bool Next(DataPoint* point) {
+    while (true) {
+      Return();
+      if (next_ >= image_.num_points) return false;
+      DataPoint p = Fetch();
+      if (p.len != kOpcodeMarker) {
+        *point = p;
+        return true;
+      }
+      DataPoint arg = Fetch();
+      if (p.angle == kOpRepeat) {
+        repeat_ = arg.len;
+      } else if (p.angle == kOpCall) {
+        if (depth_ < kMaxCallDepth && repeat_ > 0) {
+          uint16_t count = arg.angle;
+          calls_[depth_++] = Call{next_, static_cast<uint16_t>(arg.len), count,
+                                  count, repeat_};
+          next_ = arg.len;
+        }
+        repeat_ = 1;
+      }
+    }
+  }
+
+ private:
+  struct Call {
+    uint16_t ret;  // index to continue at after the call
+    uint16_t start;
+    uint16_t count;
+    uint16_t remaining;  // entries left in this pass
+    uint16_t repeats;  // passes left, including this one
+  };
+
+  DataPoint Fetch() {
+    if (depth_ > 0) calls_[depth_ - 1].remaining--;
+    return ReadImageData(&image_.points[next_++]);
+  }
+
+  // Leaves the finished calls, or starts their next pass.
+  void Return() {
+    while (depth_ > 0 && calls_[depth_ - 1].remaining == 0) {
+      Call& c = calls_[depth_ - 1];
+      if (--c.repeats > 0) {
+        c.remaining = c.count;
+        next_ = c.start;
+      } else {
+        next_ = c.ret;
+        depth_--;
+      }
+    }
+  }
+
+  Image image_;
+  uint16_t next_ = 0;  // index of the next entry to fetch
+  Call calls_[kMaxCallDepth];
+  uint8_t depth_ = 0;
+  uint16_t repeat_ = 1;  // passes of the next call
+};
+static_assert(IsImageSource<ImageReader>);
+
+// Transformation applied to the points of an image while it is drawn, so one
+// stored image covers several paper sizes. The menu only sets the scale (see
+// kPaperSizes in main.cc).
+struct ImageTransform {
+  static constexpr uint16_t kUnitScale = 1 << 14;
+
+  uint16_t scale = kUnitScale;  // of lengths, .14 fixed point
+  int16_t heading = 0;  // rotation steps before the first point
+  bool mirror = false;
+};
+
+// Applies an ImageTransform to the points of Source. The fraction lost by
+// rounding a scaled length is carried to the next point, so that scaling does
+// not add drift. A point whose scaled length or transformed angle does not fit
+// into DataPoint is split into several points: the rotation comes first, with
+// no forward move, and the rest of the length follows with angle 0.
+template <typename Source>
+class Transformed {
+ public:
+  Transformed(Source source, const ImageTransform& transform)
+      : source_(source), transform_(transform) {}
+
+  bool Next(DataPoint* p) {
+    if (len_ == 0 && angle_ == 0) {
+      if (!source_.Next(p)) return false;
+      constexpr int32_t kUnit = ImageTransform::kUnitScale;
+      int32_t len = static_cast<int32_t>(p->len) * transform_.scale + carry_;
+      len_ = (len + kUnit / 2) >> 14;
+      carry_ = len - len_ * kUnit;
+      angle_ = transform_.mirror ? -p->angle : p->angle;
+      if (first_) {
+        angle_ += transform_.heading;
+        first_ = false;
+      }
+      pen_ = p->pen;
+    }
+    int16_t angle = Clamp(angle_, -kMaxAngle - 1, kMaxAngle);
+    angle_ -= angle;
+    int16_t len = 0;
+    if (angle_ == 0) {
+      len = Clamp(len_, -kMaxLen, kMaxLen);
+      len_ -= len;
+    }
+    p->len = len;
+    p->angle = angle;
+    p->pen = pen_;
+    return true;
+  }
+
+ private:
+  // Ranges of the DataPoint fields. A len of -32768 is kOpcodeMarker.
+  static constexpr int32_t kMaxLen = 0x7fff;
+  static constexpr int32_t kMaxAngle = 0x3fff;
+
+  static int32_t Clamp(int32_t v, int32_t min, int32_t max) {
+    return v > max ? max : v < min ? min : v;
+  }
+
+  Source source_;
+  ImageTransform transform_;
+  int32_t carry_ = 0;  // .14 fixed point
+  bool first_ = true;
+  // Rest of the current point, not yet returned.
+  int32_t len_ = 0;
+  int32_t angle_ = 0;
+  uint8_t pen_ = 0;
+};
+static_assert(IsImageSource<Transformed<ImageReader>>);
+
+// State of Driver::DrawImage at the start of a point, enough to resume
+// drawing from it.
+struct DrawProgress {
+  uint32_t point;  // number of points drawn
+  uint8_t pen;  // pen state before the point
+  int16_t angle_fraction;
+  uint16_t left_remainder;
+  uint16_t right_remainder;
+};
+
+// Limits of the motion profile of the wheels.
+struct MotionLimits {
+  uint16_t max_v;  // steps / second
+  uint16_t max_a;  // steps / second^2
+  uint32_t max_j;  // steps / second^3, 0 for trapezoidal profile
+};
+
+// Moves use separate motion limits depending on their class.
+enum MoveClass : uint8_t {
+  kDrawMove,  // forward with pen down
+  kTravelMove,  // forward with pen up
+  kRotateMove,  // rotation in place
+  kNumMoveClasses
+};
+
+// Scaling of motion limits by supply voltage, as a piecewise linear function.
+// Scale is 7-bit fixed point (128 = limits as configured). Points are ordered
+// by voltage; the scale is constant outside of the range.
+constexpr uint8_t kSupplyCurvePoints = 4;
+struct SupplyCurve {
+  uint16_t mv[kSupplyCurvePoints];  // supply voltage, mV
+  uint8_t scale[kSupplyCurvePoints];  // .7 fixed point
 };
 
 struct CalibrationData {
@@ -27,15 +228,23 @@ struct CalibrationData {
   int16_t right_fraction;  // .14 fixed point
   uint16_t pen_down;
   uint16_t pen_up;
+  MotionLimits limits[kNumMoveClasses];  // indexed by MoveClass
+  SupplyCurve supply;
+  // Coils are released while the robot waits for the pen and re-energised
+  // this long before the next move. 0 keeps them energised.
+  uint8_t coil_settle_ms;
 };
 
 using CalibrationEepromPtr = CalibrationData*;
 
 template <typename Timer, typename LStepper, typename RStepper, typename Servo>
-requires IsTimer<Timer> && IsServo<Servo> && IsStepper<LStepper> &&
+requires HasTime32<Timer> && IsServo<Servo> && IsStepper<LStepper> &&
     IsStepper<RStepper>
 class Driver {
  public:
+  // Tasks posted here run while the driver waits or moves.
+  using TaskScheduler = Scheduler<Timer, 8>;
+
   Driver(Timer, LStepper lstepper, RStepper rstepper, Servo servo,
          CalibrationEepromPtr calibration)
       : left_stepper_(std::move(lstepper)),
@@ -43,6 +252,32 @@ class Driver {
         servo_(std::move(servo)),
         angle_fraction_(0) {
     eeprom_read_block(&calibration_, calibration, sizeof(CalibrationData));
+    for (uint8_t i = 0; i < kNumMoveClasses; ++i) {
+      profiles_[i] = Profile(calibration_.limits[i]);
+    }
+  }
+
+  TaskScheduler& scheduler() {
+    return scheduler_;
+  }
+
+  // Updates scaling of the motion limits, applied from the next move on.
+  void SetSupplyVoltage(uint16_t mv) {
+    const SupplyCurve& c = calibration_.supply;
+    uint8_t scale = c.scale[kSupplyCurvePoints - 1];
+    if (mv <= c.mv[0]) {
+      scale = c.scale[0];
+    } else {
+      for (uint8_t i = 1; i < kSupplyCurvePoints; ++i) {
+        if (mv < c.mv[i]) {
+          scale = c.scale[i - 1] +
+                  static_cast<int32_t>(c.scale[i] - c.scale[i - 1]) *
+                      (mv - c.mv[i - 1]) / (c.mv[i] - c.mv[i - 1]);
+          break;
+        }
+      }
+    }
+    speed_scale_ = scale;
   }
 
   void Init() {
@@ -59,6 +294,7 @@ class Driver {
   }
 
   void Pen(bool down) {
+    ReleaseCoils();
     servo_.Set(down ? calibration_.pen_down : calibration_.pen_up);
     pen_ = down;
     DelayUs(200000);  // 200ms
@@ -71,8 +307,11 @@ class Driver {
       steps = -steps;
       sign = -1;
     }
+    // Pen-up travel runs in full-step mode at speed, if the steppers support
+    // it.
     return Move(interrupted, -sign * calibration_.left_fraction,
-                sign * calibration_.right_fraction, steps);
+                sign * calibration_.right_fraction, steps,
+                profiles_[pen_ ? kDrawMove : kTravelMove], !pen_);
   }
 
   template <typename Interrupted>
@@ -93,7 +332,8 @@ class Driver {
       }
     }
     bool val = Move(interrupted, -sign * calibration_.left_fraction,
-                    -sign * calibration_.right_fraction, steps);
+                    -sign * calibration_.right_fraction, steps,
+                    profiles_[kRotateMove]);
     if (kLiftPenWhenRotating) {
       if (pen) {
         Pen(true);
@@ -119,26 +359,93 @@ class Driver {
     return RotateSteps(interrupted, d);
   }
 
-  // `image` is a progmem pointer.
+  // `image_ptr` is an image data pointer, see IMAGE_DATA.
   template <typename Interrupted>
-  bool DrawImage(const Interrupted& interrupted, const Image* image_ptr) {
-    Image image;
-    memcpy_P(&image, image_ptr, sizeof(Image));
-    uint8_t pen;
-    uint16_t i;
-    for (i = 0; i < image.num_points; ++i) {
-      DataPoint p;
-      memcpy_P(&p, &image.points[i], sizeof(DataPoint));
-      if (i == 0 || pen != p.pen) {
+  bool DrawImage(const Interrupted& interrupted, const Image* image_ptr,
+                 const ImageTransform& transform = {}) {
+    Transformed source(ImageReader(image_ptr), transform);
+    DrawProgress progress = Progress(0, false);
+    return DrawImage(interrupted, &source, &progress,
+                     [](const DrawProgress&, bool) {});
+  }
+
+  // Draws the points of `source` starting from `progress`, which is updated
+  // before each point. `save_progress(progress, force)` is called at point
+  // boundaries with force = false, and with force = true and the progress at
+  // the start of the interrupted point if drawing stops early.
+  //
+  // Points are prepared by a scheduler task, which fetches the next point
+  // while the current one is being executed.
+  template <typename Interrupted, typename Source, typename SaveProgress>
+  requires IsImageSource<Source>
+  bool DrawImage(const Interrupted& interrupted, Source* source,
+                 DrawProgress* progress, const SaveProgress& save_progress) {
+    Prefetcher<Source> prefetcher{source};
+    angle_fraction_ = progress->angle_fraction;
+    left_remainder_ = progress->left_remainder;
+    right_remainder_ = progress->right_remainder;
+    uint32_t first = progress->point;
+    uint8_t pen = progress->pen;
+    // Positions in the source may be ambiguous (calls in images), so resuming
+    // replays the drawn points without moving.
+    for (uint32_t i = 0; i < first; ++i) {
+      Prefetcher<Source>::Prepare(&prefetcher);
+      prefetcher.ready = false;
+    }
+    scheduler_.Post(&Prefetcher<Source>::Prepare, &prefetcher);
+    bool finished = false;
+    for (uint32_t i = first;; ++i) {
+      // Normally prepared during the previous move.
+      if (!prefetcher.ready) Prefetcher<Source>::Prepare(&prefetcher);
+      if (!prefetcher.ready) {
+        finished = true;
+        break;
+      }
+      DataPoint p = prefetcher.point;
+      prefetcher.ready = false;
+      scheduler_.Post(&Prefetcher<Source>::Prepare, &prefetcher);
+
+      *progress = Progress(i, pen);
+      save_progress(*progress, false);
+      if (i == first || pen != p.pen) {
+        Pen(p.pen);
+        pen = p.pen;
+      }
+      if (!RotateSteps(interrupted, p.angle) ||
+          !ForwardSteps(interrupted, p.len)) {
+        save_progress(*progress, true);
+        break;
+      }
+    }
+    scheduler_.Cancel(&Prefetcher<Source>::Prepare, &prefetcher);
+    Pen(false);
+    Off();
+    return finished;
+  }
+
+  // Draws points received by `stream` (see StreamReceiver) until the host
+  // ends the stream. If the points do not come in time, the robot waits in
+  // place for more, with the coils released as while the pen moves.
+  template <typename Interrupted, typename Stream>
+  bool DrawStream(const Interrupted& interrupted, Stream* stream) {
+    StreamPoller<Stream> poller{this, stream};
+    scheduler_.Post(&StreamPoller<Stream>::Poll, &poller);
+    bool first = true;
+    uint8_t pen = false;
+    bool ok = true;
+    DataPoint p;
+    while (ok && WaitForPoint(interrupted, stream, &p)) {
+      if (first || pen != p.pen) {
         Pen(p.pen);
         pen = p.pen;
       }
-      if (!RotateSteps(interrupted, p.angle)) break;
-      if (!ForwardSteps(interrupted, p.len)) break;
+      first = false;
+      ok = RotateSteps(interrupted, p.angle) && ForwardSteps(interrupted, p.len);
     }
+    scheduler_.Cancel(&StreamPoller<Stream>::Poll, &poller);
     Pen(false);
     Off();
-    return i >= image.num_points;
+    return ok && stream->Done();
   }
 
   template <typename Interrupted>
@@ -176,10 +483,125 @@ class Driver {
  private:
   static constexpr bool kLiftPenWhenRotating = false;
 
+  // Acceleration of the S-curve profile keeps this many extra bits.
+  static constexpr int8_t kJerkShift = 16;
+
+  // Full-step drive only above this speed, steps / tick, 48-bit fixed point.
+  // Slower, each full step makes the rotor ring and it may lose steps: with
+  // full-step travel at any speed, the Hilbert curve of runner_host_test ends
+  // up more than 10mm off.
+  static constexpr int64_t kFullStepMinV = (400ll << 40) / F_CPU << 8;
+
+  // Motion limits converted to the fixed point units used by Wheel.
+  struct Profile {
+    Profile() = default;
+
+    explicit Profile(const MotionLimits& limits) {
+      max_v = (static_cast<int64_t>(limits.max_v) << 40) / F_CPU << 8;
+      max_a = (static_cast<int64_t>(limits.max_a) << 40) / F_CPU;
+      max_a = (max_a << 8) / F_CPU;
+      if (limits.max_j == 0) {
+        max_j = 0;
+        brake_ticks = 0;
+      } else {
+        max_j = (static_cast<int64_t>(limits.max_j) << 24) / F_CPU;
+        max_j = (max_j << 24) / F_CPU;
+        max_j = (max_j << 16) / F_CPU;
+        if (max_j == 0) max_j = 1;
+        // Ramping acceleration between 0 and max_a takes max_a / max_j ticks
+        // and adds half of that time to the braking distance.
+        brake_ticks = (max_a << kJerkShift) / max_j / 2;
+      }
+    }
+
+    // Returns the profile with limits scaled by `scale`, .7 fixed point. The
+    // jerk limit is scaled too, so the braking time stays the same.
+    Profile Scaled(uint8_t scale) const {
+      Profile p = *this;
+      p.max_v = (max_v * scale) >> 7;
+      p.max_a = (max_a * scale) >> 7;
+      p.max_j = (max_j * scale) >> 7;
+      if (p.max_a == 0) p.max_a = 1;
+      if (max_j != 0 && p.max_j == 0) p.max_j = 1;
+      return p;
+    }
+
+    int64_t max_v;  // steps / tick, 48-bit fixed point
+    int64_t max_a;  // steps / tick^2, 48-bit fixed point
+    int64_t max_j;  // steps / tick^3, 64-bit fixed point, 0 for trapezoid
+    int64_t brake_ticks;  // extra braking time due to the jerk limit
+  };
+
   [[no_unique_address]] LStepper left_stepper_;
   [[no_unique_address]] RStepper right_stepper_;
   [[no_unique_address]] Servo servo_;
 
+  // Prepare step of DrawImage: fetches the next point while the current one
+  // is being drawn.
+  template <typename Source>
+  struct Prefetcher {
+    static void Prepare(void* context) {
+      Prefetcher* p = static_cast<Prefetcher*>(context);
+      if (p->ready || p->end) return;
+      p->ready = p->source->Next(&p->point);
+      p->end = !p->ready;
+    }
+
+    Source* source;
+    bool ready = false;  // `point` is prepared
+    bool end = false;  // source has no more points
+    DataPoint point = {};
+  };
+
+  // Scheduler task sending answers and free space of DrawStream's stream.
+  template <typename Stream>
+  struct StreamPoller {
+    static constexpr uint32_t kPeriod = F_CPU / 1000;  // 1ms
+
+    static void Poll(void* context) {
+      StreamPoller* p = static_cast<StreamPoller*>(context);
+      p->stream->Poll();
+      p->driver->scheduler_.Post(&Poll, context, kPeriod);
+    }
+
+    Driver* driver;
+    Stream* stream;
+  };
+
+  // Returns false if the stream ended or drawing was interrupted.
+  template <typename Interrupted, typename Stream>
+  bool WaitForPoint(const Interrupted& interrupted, Stream* stream,
+                    DataPoint* p) {
+    while (!stream->Pop(p)) {
+      if (stream->Done() || interrupted()) return false;
+      // The host may take a while, do not heat the coils meanwhile.
+      ReleaseCoils();
+      scheduler_.RunDue();
+      // Received data wakes up the cpu as well.
+      if constexpr (HasIdle<Timer>) Timer::Idle();
+    }
+    return true;
+  }
+
+  // Releases the coils while the robot stands, if the calibration gives a
+  // time to settle them again before the next move.
+  void ReleaseCoils() {
+    if (calibration_.coil_settle_ms == 0 || coils_released_) return;
+    left_stepper_.Off();
+    right_stepper_.Off();
+    coils_released_ = true;
+  }
+
+  DrawProgress Progress(uint32_t point, uint8_t pen) const {
+    return DrawProgress{point, pen, angle_fraction_, left_remainder_,
+                        right_remainder_};
+  }
+
+  void SetFullStep(bool full_step) {
+    if constexpr (HasFullStep<LStepper>) left_stepper_.SetFullStep(full_step);
+    if constexpr (HasFullStep<RStepper>) right_stepper_.SetFullStep(full_step);
+  }
+
   static int16_t FractionalMove(uint16_t s, int16_t fraction, int16_t* position,
                                 uint16_t* remainder) {
     int32_t p = static_cast<int32_t>(s) * fraction + *remainder;
@@ -194,54 +616,120 @@ class Driver {
   // Returns false if interrupted.
   template <typename Interrupted>
   bool Move(const Interrupted& interrupted, int16_t left_fraction,
-            int16_t right_fraction, uint16_t d) {
+            int16_t right_fraction, uint16_t d, const Profile& limits,
+            bool full_step = false) {
+    const Profile profile = limits.Scaled(speed_scale_);
+    if (coils_released_) {
+      // Hold the last position again and let the rotors settle there.
+      left_stepper_.Move(0);
+      right_stepper_.Move(0);
+      coils_released_ = false;
+      DelayUs(static_cast<uint32_t>(calibration_.coil_settle_ms) * 1000);
+    }
     Wheel w;
     uint16_t s = 0;
     int16_t l = 0;
     int16_t r = 0;
-    uint16_t start = Timer::GetTime();
+    bool full = false;
+    bool done = true;
+    uint32_t start = Timer::GetTime32();
     while (s < d) {
-      uint16_t end = Timer::GetTime();
-      bool braking = ((w.v_ / (2 * Wheel::kMaxA)) * w.v_) >> 48 >= d - s;
-      s += w.Update(end - start, braking ? -Wheel::kMaxA : Wheel::kMaxA);
+      uint32_t end = Timer::GetTime32();
+      uint32_t dt = end - start;
       start = end;
+      bool braking = w.Braking(profile, d - s);
+      // Slow iteration, integrate in steps Wheel::Update can handle.
+      while (dt > 0xffff) {
+        s += w.Update(profile, 0xffff, braking);
+        dt -= 0xffff;
+      }
+      s += w.Update(profile, dt, braking);
 
+      bool fast = full_step && w.v_ >= kFullStepMinV;
+      if (fast != full) {
+        full = fast;
+        SetFullStep(full);
+      }
       left_stepper_.Move(FractionalMove(s, left_fraction, &l, &left_remainder_));
       right_stepper_.Move(FractionalMove(s, right_fraction, &r, &right_remainder_));
 
-      if (interrupted()) return false;
+      scheduler_.RunDue(end);
+      if (interrupted()) {
+        done = false;
+        break;
+      }
     }
-    return true;
+    if (full) SetFullStep(false);
+    return done;
   }
 
   void DelayUs(uint32_t t) {
     t *= F_CPU / 1000000;
-    uint16_t begin = Timer::GetTime();
+    uint32_t begin = Timer::GetTime32();
     while (true) {
-      uint16_t end = Timer::GetTime();
-      uint16_t delta = end - begin;
-      if (delta > t) break;
-      t -= delta;
-      begin = end;
+      uint32_t now = Timer::GetTime32();
+      if (now - begin > t) break;
+      scheduler_.RunDue(now);
+      // Scheduled tasks may run up to kMaxIdle late.
+      if constexpr (HasIdle<Timer>) {
+        if (t - (now - begin) > Timer::kMaxIdle) Timer::Idle();
+      }
     }
   }
 
   struct Wheel {
     int64_t s_ = 0;  // steps, 48-bit fixed point
     int64_t v_ = 0;  // steps / tick, 48-bit fixed point
+    int64_t a_ = 0;  // steps / tick^2, 64-bit fixed point (S-curve only)
+
+    // Returns true if the wheel needs to start braking in order to stop
+    // within `remaining` steps.
+    bool Braking(const Profile& p, uint16_t remaining) const {
+      int64_t t = v_ / (2 * p.max_a) + p.brake_ticks;
+      if (a_ > 0) t += a_ / p.max_j;  // time to stop accelerating
+      return (t * v_) >> 48 >= remaining;
+    }
 
-    static constexpr int64_t kMaxV = (750ll << 48) / F_CPU;  // 750 step/second
-    static constexpr int64_t kMaxA =
-        kMaxV / (F_CPU / 10);  // 0 to kMaxV in 100ms
+    // Update state for `dt_ticks`, accelerating towards p.max_v or braking.
+    // Returns number of steps of the motor.
+    int8_t Update(const Profile& p, uint16_t dt_ticks, bool braking) {
+      int64_t a;
+      if (p.max_j == 0) {
+        a = braking ? -p.max_a : p.max_a;
+      } else {
+        // S-curve: slew acceleration towards its target with the jerk limit.
+        int64_t target;
+        if (braking) {
+          target = -(p.max_a << kJerkShift);
+        } else if (a_ > 0 &&
+                   v_ + (((a_ / (2 * p.max_j)) * a_) >> kJerkShift) >=
+                       p.max_v) {
+          target = 0;  // Ease into the cruising speed.
+        } else {
+          target = p.max_a << kJerkShift;
+        }
+        int64_t da = p.max_j * dt_ticks;
+        if (a_ < target) {
+          a_ = (target - a_ > da) ? a_ + da : target;
+        } else {
+          a_ = (a_ - target > da) ? a_ - da : target;
+        }
+        a = a_ >> kJerkShift;
+      }
 
-    // Update state for `dt_ticks` with acceleration `a`. Acceleration must be
-    // between -kMaxA and +kMaxA. Returns number of steps of the motor.
-    int8_t Update(uint16_t dt_ticks, int64_t a) {
       int64_t v2 = v_ + a * dt_ticks;
-      if (v2 > kMaxV) {
-        v2 = kMaxV;
-      } else if (v2 < -kMaxV) {
-        v2 = -kMaxV;
+      if (v2 > p.max_v) {
+        v2 = p.max_v;
+        if (a_ > 0) a_ = 0;
+      } else if (v2 < -p.max_v) {
+        v2 = -p.max_v;
+      }
+      if (p.max_j != 0 && v2 < 0) {
+        // Do not reverse; creep forward from standstill if still short. Also
+        // after braking ends, while the acceleration slews back up from
+        // -max_a.
+        v2 = 0;
+        a_ = 0;
       }
       s_ += (v_ + v2) * dt_ticks / 2;
       v_ = v2;
@@ -257,8 +745,12 @@ class Driver {
   };
 
   bool pen_ = false;
+  bool coils_released_ = false;
 
   CalibrationData calibration_;
+  Profile profiles_[kNumMoveClasses];
+  TaskScheduler scheduler_;
+  uint8_t speed_scale_ = 128;  // .7 fixed point, see SupplyCurve
   int16_t angle_fraction_;
   uint16_t left_remainder_ = 0;
   uint16_t right_remainder_ = 0;
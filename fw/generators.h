@@ -0,0 +1,292 @@
+#ifndef GENERATORS_H_
+#define GENERATORS_H_
+
+#include <stdint.h>
+
+#include "driver.h"
+
+// Procedural image sources, computed on the fly in fixed point.
+//
+// A curve produces target points in steps; CurveSource turns them into the
+// relative moves of DataPoints with a Turtle. Angles are binary, 65536 is a
+// full turn. Each curve takes a variant 1 - kGeneratorVariants.
+
+constexpr uint8_t kGeneratorVariants = 4;
+
+// Half of the size of the curves, in steps (about 75mm).
+constexpr int32_t kGeneratorRadius = 2000;
+
+// CORDIC
+
+constexpr uint8_t kCordicIterations = 16;
+constexpr uint16_t kCordicAtan[kCordicIterations] = {
+    8192, 4836, 2555, 1297, 651, 326, 163, 81, 41, 20, 10, 5, 3, 1, 1, 0};
+constexpr int32_t kCordicGain = 39797;  // 1 / 1.6468, .16 fixed point
+
+// Rotates (x, y) by `angle`. The result is scaled up by the CORDIC gain.
+inline void CordicRotate(uint16_t angle, int32_t* x, int32_t* y) {
+  int16_t z = angle;
+  if (z > 16384 || z < -16384) {
+    // Bring the angle into the converging range, -90 to 90 degrees.
+    *x = -*x;
+    *y = -*y;
+    z = static_cast<uint16_t>(angle + 32768);
+  }
+  for (uint8_t i = 0; i < kCordicIterations; ++i) {
+    int32_t dx = *x >> i;
+    int32_t dy = *y >> i;
+    if (z >= 0) {
+      *x -= dy;
+      *y += dx;
+      z -= kCordicAtan[i];
+    } else {
+      *x += dy;
+      *y -= dx;
+      z += kCordicAtan[i];
+    }
+  }
+}
+
+// Point at distance `r` in direction `angle`.
+inline void Polar(int32_t r, uint16_t angle, int32_t* x, int32_t* y) {
+  *x = (static_cast<int64_t>(r) * kCordicGain) >> 16;
+  *y = 0;
+  CordicRotate(angle, x, y);
+}
+
+// Direction and length of (x, y).
+inline void CordicVector(int32_t x, int32_t y, uint16_t* angle, int32_t* len) {
+  uint16_t a = 0;
+  if (x < 0) {
+    x = -x;
+    y = -y;
+    a = 32768;
+  }
+  for (uint8_t i = 0; i < kCordicIterations; ++i) {
+    int32_t dx = x >> i;
+    int32_t dy = y >> i;
+    if (y > 0) {
+      x += dy;
+      y -= dx;
+      a += kCordicAtan[i];
+    } else {
+      x -= dy;
+      y += dx;
+      a -= kCordicAtan[i];
+    }
+  }
+  *angle = a;
+  *len = (static_cast<int64_t>(x) * kCordicGain) >> 16;
+}
+
+// Turns target points into moves. The position and heading after the rounded
+// moves are tracked, so rounding errors do not accumulate.
+class Turtle {
+ public:
+  // Move from the current position to (x, y), in steps. The len is 0 if the
+  // target is closer than half a step.
+  DataPoint MoveTo(int32_t x, int32_t y, bool pen) {
+    uint16_t direction;
+    int32_t r;
+    CordicVector((x << kShift) - x_, (y << kShift) - y_, &direction, &r);
+    int32_t len = (r + (1 << (kShift - 1))) >> kShift;
+    if (len > 0x7fff) len = 0x7fff;
+
+    DataPoint p;
+    p.len = len;
+    p.angle = 0;
+    p.pen = pen;
+    if (len == 0) return p;
+
+    // Positive angle turns right, like in gendata.
+    int32_t turn = -static_cast<int32_t>(
+                       static_cast<int16_t>(direction - Heading())) *
+                   kTurnSteps10;
+    int16_t steps = (turn + (turn >= 0 ? 327680 : -327680)) / 655360;
+    heading10_ -= steps * 10;
+    if (heading10_ < 0) heading10_ += kTurnSteps10;
+    if (heading10_ >= kTurnSteps10) heading10_ -= kTurnSteps10;
+
+    int32_t dx;
+    int32_t dy;
+    Polar(len << kShift, Heading(), &dx, &dy);
+    x_ += dx;
+    y_ += dy;
+    p.angle = steps;
+    return p;
+  }
+
+ private:
+  static constexpr int8_t kShift = 8;
+  // Rotation steps per turn * 10, see Driver::Rotate.
+  static constexpr int32_t kTurnSteps10 = 62616;
+
+  uint16_t Heading() const {
+    return static_cast<uint32_t>(heading10_) * 65536 / kTurnSteps10;
+  }
+
+  int32_t x_ = 0;  // steps, .8 fixed point
+  int32_t y_ = 0;
+  int32_t heading10_ = 0;  // rotation steps * 10
+};
+
+// Image source drawing a curve. The robot starts in the center of the curve.
+//
+// Curve has bool Point(int32_t* x, int32_t* y, bool* pen), which returns the
+// next target point and false at the end.
+template <typename Curve>
+class CurveSource {
+ public:
+  explicit CurveSource(Curve curve) : curve_(curve) {}
+
+  bool Next(DataPoint* p) {
+    do {
+      int32_t x;
+      int32_t y;
+      bool pen;
+      if (!curve_.Point(&x, &y, &pen)) return false;
+      *p = turtle_.MoveTo(x, y, pen);
+    } while (p->len == 0);
+    return true;
+  }
+
+ private:
+  Curve curve_;
+  Turtle turtle_;
+};
+
+// Archimedean spiral with 2 + 2 * variant turns.
+class SpiralCurve {
+ public:
+  explicit SpiralCurve(uint8_t variant) : points_((2 + 2 * variant) * 64) {}
+
+  bool Point(int32_t* x, int32_t* y, bool* pen) {
+    if (i_ > points_) return false;
+    Polar(kGeneratorRadius * i_ / points_, i_ * 1024, x, y);
+    *pen = i_ > 0;
+    i_++;
+    return true;
+  }
+
+ private:
+  uint16_t points_;
+  uint16_t i_ = 0;
+};
+
+// Hypotrochoid: a circle of radius r rolls inside a circle of radius R, the
+// pen is at distance d from its center.
+class SpirographCurve {
+ public:
+  explicit SpirographCurve(uint8_t variant) {
+    static constexpr uint8_t kShapes[kGeneratorVariants][3] = {
+        {5, 3, 5}, {7, 4, 3}, {8, 5, 5}, {11, 7, 6}};
+    const uint8_t* s = kShapes[(variant - 1) % kGeneratorVariants];
+    big_ = s[0];
+    small_ = s[1];
+    unit_ = kGeneratorRadius / (big_ - small_ + s[2]);
+    distance_ = s[2];
+  }
+
+  bool Point(int32_t* x, int32_t* y, bool* pen) {
+    // The curve closes after `small_` turns (the ratios are coprime).
+    if (i_ > small_ * kPointsPerTurn) return false;
+    uint32_t t = static_cast<uint32_t>(i_) * (65536 / kPointsPerTurn);
+    int32_t x2;
+    int32_t y2;
+    Polar((big_ - small_) * unit_, t, x, y);
+    Polar(distance_ * unit_, -(t * (big_ - small_) / small_), &x2, &y2);
+    *x += x2;
+    *y += y2;
+    *pen = i_ > 0;
+    i_++;
+    return true;
+  }
+
+ private:
+  static constexpr uint16_t kPointsPerTurn = 128;
+
+  uint8_t big_;
+  uint8_t small_;
+  uint8_t distance_;
+  int32_t unit_;
+  uint16_t i_ = 0;
+};
+
+// Lissajous figure x = sin(a t + 90 / a degrees), y = sin(b t).
+class LissajousCurve {
+ public:
+  explicit LissajousCurve(uint8_t variant) {
+    static constexpr uint8_t kRatios[kGeneratorVariants][2] = {
+        {1, 2}, {3, 2}, {3, 4}, {5, 4}};
+    const uint8_t* r = kRatios[(variant - 1) % kGeneratorVariants];
+    a_ = r[0];
+    b_ = r[1];
+    points_ = 128 * (a_ + b_);
+  }
+
+  bool Point(int32_t* x, int32_t* y, bool* pen) {
+    if (i_ > points_) return false;
+    uint16_t t = static_cast<uint32_t>(i_) * 65536 / points_;
+    int32_t unused;
+    Polar(kGeneratorRadius, a_ * t + 16384 / a_, &unused, x);
+    Polar(kGeneratorRadius, b_ * t, &unused, y);
+    *pen = i_ > 0;
+    i_++;
+    return true;
+  }
+
+ private:
+  uint8_t a_;
+  uint8_t b_;
+  uint16_t points_;
+  uint16_t i_ = 0;
+};
+
+// Hilbert curve of order 2 + variant, filling a square.
+class HilbertCurve {
+ public:
+  explicit HilbertCurve(uint8_t variant)
+      : side_(1 << (2 + (variant - 1) % kGeneratorVariants + 1)),
+        cell_(2 * kGeneratorRadius / side_) {}
+
+  bool Point(int32_t* x, int32_t* y, bool* pen) {
+    if (d_ >= side_ * side_) return false;
+    uint8_t hx;
+    uint8_t hy;
+    Position(d_, &hx, &hy);
+    *x = -kGeneratorRadius + cell_ * hx + cell_ / 2;
+    *y = -kGeneratorRadius + cell_ * hy + cell_ / 2;
+    *pen = d_ > 0;
+    d_++;
+    return true;
+  }
+
+ private:
+  // Cell of the curve at distance `d` along it.
+  void Position(uint16_t d, uint8_t* x, uint8_t* y) const {
+    *x = 0;
+    *y = 0;
+    for (uint8_t s = 1; s < side_; s *= 2) {
+      uint8_t rx = 1 & (d / 2);
+      uint8_t ry = 1 & (d ^ rx);
+      if (ry == 0) {
+        if (rx == 1) {
+          *x = s - 1 - *x;
+          *y = s - 1 - *y;
+        }
+        uint8_t t = *x;
+        *x = *y;
+        *y = t;
+      }
+      *x += s * rx;
+      *y += s * ry;
+      d /= 4;
+    }
+  }
+
+  uint8_t side_;  // cells per side
+  int32_t cell_;  // steps
+  uint16_t d_ = 0;
+};
+
+#endif  // GENERATORS_H_
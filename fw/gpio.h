@@ -55,7 +55,7 @@ class DynamicGpio {
 // Implementation follows.
 
 namespace internal {
-#if defined(__AVR_ATmega328PB__)  // used in simavr
+#if defined(__AVR_ATmega328PB__) || !defined(__AVR__)  // simavr, host tests
 // TODO: implement if needed
 struct GpioImpl {
   static inline void ConfigureOutput(GpioPortId /*port*/, uint8_t /*mask*/) {
@@ -198,7 +198,7 @@ void DynamicGpio::SetPullup(bool value) {
 }
 
 namespace testing {
-static_assert(IsGpio<StaticGpio<A, 1>>);
+static_assert(IsGpio<StaticGpio<::A, 1>>);
 static_assert(IsGpio<DynamicGpio>);
 }  // namespace
 
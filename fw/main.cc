@@ -1,13 +1,16 @@
 #include <avr/interrupt.h>
 #include <avr/io.h>
 #include <avr/sleep.h>
-#include <util/delay.h>
+#include <util/atomic.h>
 
 #include <stdint.h>
 
+#include "checkpoint.h"
 #include "gpio.h"
 #include "driver.h"
+#include "generators.h"
 #include "motors.h"
+#include "stream.h"
 #include "utils.h"
 #include "stl.h"
 
@@ -20,12 +23,24 @@
 static_assert(F_CPU == 16000000, "Unexpected CPU frequency.");
 
 // Image data
-Image const * const kImages[] PROGMEM = {
+Image const * const kImages[] IMAGE_DATA = {
   &kExample,
 };
 
 constexpr int8_t kNumImages = sizeof(kImages) / sizeof(const Image*);
 
+// Paper sizes the images can be drawn at. They are generated for A3.
+constexpr uint8_t kNumPaperSizes = 3;
+constexpr ImageTransform kPaperSizes[kNumPaperSizes] = {
+  {},  // A3
+  {.scale = 11585},  // A4, 1 / sqrt(2)
+  {.scale = 23170},  // A2, sqrt(2)
+};
+
+// Procedural images follow the images in the menu, see generators.h.
+constexpr uint8_t kNumGenerators = 4;
+constexpr uint8_t kNumDrawable = kNumImages + kNumGenerators;
+
 // Calibration data in eeprom. This should be updated for each robot.
 #if ID == 1
 CalibrationData kCalibrationData EEMEM {
@@ -34,11 +49,41 @@ CalibrationData kCalibrationData EEMEM {
   .right_fraction = 1 << 14,
   .pen_down = 1400,
   .pen_up = 800,
+  .limits = {
+    // kDrawMove
+    {
+      .max_v = 750,  // steps/s
+      .max_a = 7500,  // 0 to max_v in 100ms
+      .max_j = 0,  // trapezoidal profile
+    },
+    // kTravelMove
+    {
+      .max_v = 750,
+      .max_a = 7500,
+      .max_j = 0,
+    },
+    // kRotateMove
+    {
+      .max_v = 750,
+      .max_a = 7500,
+      .max_j = 0,
+    },
+  },
+  .supply = {
+    // Scale limits down as the cells drain. Tune together with limits.
+    .mv = {2900, 3100, 3300, 3600},
+    .scale = {128, 128, 128, 128},
+  },
+  .coil_settle_ms = 20,
 };
 #endif
 
 static uint16_t kServoPeriod EEMEM = 20000;  // servo update period in us
 
+// Drawing progress, see CheckpointStore.
+constexpr uint8_t kCheckpointSlots = 8;
+Checkpoint kCheckpoints[kCheckpointSlots] EEMEM;
+
 //
 // Low-level functionality
 //
@@ -48,14 +93,73 @@ inline void UnlockConfig() {
   CCP = CCP_IOREG_gc;
 }
 
+// Timer utils
+
+// Measure time when cpu is running, cpu clocks.
+// This class takes ownership of TCB0.
+class Timer {
+ public:
+  static void Init() {
+    TCB0.CCMP = 0xffff;  // full 16-bit period
+    TCB0.INTCTRL = TCB_CAPT_bm;  // overflow interrupt
+    TCB0.CTRLA = 0x01;  // enable
+  }
+
+  static uint16_t GetTime() {
+    return TCB0.CNT;
+  }
+
+  // 32-bit time, upper half counts overflows of TCB0. With interrupts off,
+  // e.g. during BoardInit(), overflows are counted here instead of in Irq(),
+  // so the time advances as long as it is read at least once per overflow.
+  static uint32_t GetTime32() {
+    bool irq_enabled = SREG & CPU_I_bm;
+    uint16_t high;
+    uint16_t low;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      if (!irq_enabled && (TCB0.INTFLAGS & TCB_CAPT_bm)) {
+        TCB0.INTFLAGS = TCB_CAPT_bm;
+        overflows_ = overflows_ + 1;
+      }
+      high = overflows_;
+      low = TCB0.CNT;
+      // Counter wrapped, but the interrupt did not run yet.
+      if ((TCB0.INTFLAGS & TCB_CAPT_bm) && low < 0x8000) high++;
+    }
+    return (static_cast<uint32_t>(high) << 16) | low;
+  }
+
+  // Called from the overflow interrupt.
+  static void Irq() {
+    overflows_ = overflows_ + 1;
+  }
+
+  // Idle sleep, peripherals keep running. The overflow interrupt wakes the cpu
+  // at the latest after kMaxIdle ticks. Does nothing if interrupts are off.
+  static constexpr uint32_t kMaxIdle = 0x10000;
+  static void Idle() {
+    if (!(SREG & CPU_I_bm)) return;
+    SLPCTRL.CTRLA = SLPCTRL_SMODE_IDLE_gc | SLPCTRL_SEN_bm;
+    sleep_cpu();
+    SLPCTRL.CTRLA = 0x00;
+  }
+
+ private:
+  static inline volatile uint16_t overflows_ = 0;
+};
+static_assert(HasTime32<Timer> && HasIdle<Timer>);
+
 // Delay utils
+
+// The cpu idles in between timer overflows if interrupts are enabled, and polls
+// the timer otherwise.
 void DelayUs(uint32_t v) {
-  v = (v * (F_CPU / 1000000)) / 4;
-  if (v & 0xffff) {
-    _delay_loop_2(v & 0xffff);
-  }
-  for (uint16_t i = v >> 16; i > 0; --i) {
-    _delay_loop_2(0xffff);
+  uint32_t ticks = v * (F_CPU / 1000000);
+  uint32_t begin = Timer::GetTime32();
+  while (true) {
+    uint32_t elapsed = Timer::GetTime32() - begin;
+    if (elapsed >= ticks) break;
+    if (ticks - elapsed > Timer::kMaxIdle) Timer::Idle();
   }
 }
 
@@ -75,35 +179,16 @@ void BlinkNum(Gpio& led, uint8_t num) {
   }
 }
 
-// Timer utils
-
-// Measure time when cpu is running, cpu clocks.
-// This class takes ownership of TCB0.
-class Timer {
- public:
-  static void Init() {
-    TCB0.CCMP = 0xffff;  // full 16-bit period
-    TCB0.CTRLA = 0x01;  // enable
-  }
-
-  static uint16_t GetTime() {
-    return TCB0.CNT;
-  }
-};
-static_assert(IsTimer<Timer>);
-
 template <typename Timer, typename Led, typename Button>
 uint8_t SelectNumber(Led* led, Button* button, uint8_t min, uint8_t max,
                      uint8_t curr) {
   auto delay = [&](bool break_value, uint32_t us) -> bool {
-    uint16_t begin = Timer::GetTime();
+    uint32_t begin = Timer::GetTime32();
     uint32_t ticks = us * (F_CPU / 1000000);
     while(button->Get() != break_value) {
-      uint16_t end = Timer::GetTime();
-      uint16_t delta = end - begin;
-      if (delta > ticks) return false;
-      ticks -= delta;
-      begin = end;
+      if (Timer::GetTime32() - begin > ticks) return false;
+      // Button edges wake up the cpu as well.
+      Timer::Idle();
     }
     return true;
   };
@@ -268,6 +353,49 @@ class Servo {
 };
 static_assert(IsServo<Servo<StaticGpio<A, 1>, StaticValue<uint8_t, 1>>>);
 
+// Microstepping
+#if MICROSTEP
+
+// Microsteps per half-step, PWM resolution and PWM frequency.
+constexpr uint8_t kMicrosteps = 8;
+constexpr uint8_t kPwmLevels = 16;
+constexpr uint32_t kPwmFrequency = 2000;  // Hz
+
+// Timer driving PwmCoils::Tick() at kPwmLevels * kPwmFrequency.
+// This class takes ownership of TCB1.
+struct MicrostepTimer {
+  static void Init() {
+    static_assert(F_CPU / (kPwmLevels * kPwmFrequency) <= 0x10000);
+    TCB1.CCMP = F_CPU / (kPwmLevels * kPwmFrequency) - 1;
+    TCB1.CTRLB = TCB_CNTMODE_INT_gc;  // periodic interrupt
+    TCB1.INTCTRL = TCB_CAPT_bm;
+    TCB1.CTRLA = TCB_CLKSEL_DIV1_gc | TCB_ENABLE_bm;
+  }
+};
+#endif  // MICROSTEP
+
+// Uart for streaming images from the host, 115200 baud 8N1 on A0 (TxD) and A1
+// (RxD). This class takes ownership of USART0.
+struct Usart0 {
+  static constexpr uint32_t kBaud = 115200;
+
+  static void Init() {
+    StaticGpio<A, 0>().ConfigureOutput();
+    USART0.BAUD = (4 * F_CPU + kBaud / 2) / kBaud;
+    USART0.CTRLA = USART_RXCIE_bm;
+    USART0.CTRLB = USART_RXEN_bm | USART_TXEN_bm;
+  }
+
+  static bool CanWrite() {
+    return USART0.STATUS & USART_DREIF_bm;
+  }
+
+  static void Write(uint8_t b) {
+    USART0.TXDATAL = b;
+  }
+};
+static_assert(IsUart<Usart0>);
+
 // Peripherals:
 StaticGpio<F, 5> left_eye;
 StaticGpio<F, 2> right_eye;
@@ -275,6 +403,24 @@ StaticGpio<D, 7> button;
 
 Power power{StaticGpio<A, 6>(), StaticGpio<A, 7>(), StaticGpio<C, 0>()};
 
+#if MICROSTEP
+using LeftCoils = List<StaticGpio<D, 6>, StaticGpio<D, 5>, StaticGpio<D, 4>,
+                      StaticGpio<D, 3>>;
+using RightCoils = List<StaticGpio<D, 2>, StaticGpio<D, 1>, StaticGpio<C, 3>,
+                        StaticGpio<C, 2>>;
+PwmCoils<LeftCoils, kMicrosteps, kPwmLevels> left_coils{LeftCoils(
+    StaticGpio<D, 6>(), StaticGpio<D, 5>(), StaticGpio<D, 4>(),
+    StaticGpio<D, 3>())};
+PwmCoils<RightCoils, kMicrosteps, kPwmLevels> right_coils{RightCoils(
+    StaticGpio<D, 2>(), StaticGpio<D, 1>(), StaticGpio<C, 3>(),
+    StaticGpio<C, 2>())};
+
+Driver driver{Timer(),
+              MicroStepper(&left_coils),
+              MicroStepper(&right_coils),
+              Servo(StaticGpio<C, 1>(), StaticValue<uint8_t, 1>()),
+              &kCalibrationData};
+#else
 Driver driver{Timer(),
               Stepper(List(StaticGpio<D, 6>(), StaticGpio<D, 5>(),
                            StaticGpio<D, 4>(), StaticGpio<D, 3>())),
@@ -282,11 +428,123 @@ Driver driver{Timer(),
                            StaticGpio<C, 3>(), StaticGpio<C, 2>())},
               Servo(StaticGpio<C, 1>(), StaticValue<uint8_t, 1>()),
               &kCalibrationData};
+#endif
+
+// Request to stop the running motion, latched by the pin change interrupts of
+// the button and the power good pin. The motion loop reads a single volatile
+// byte; pins are re-checked only after an interrupt latched a request, which
+// also filters out glitches and short power drops.
+class StopRequest {
+ public:
+  // Resets the state before a new run.
+  void Arm() {
+    cli();
+    flags_ = (button.Get() ? 0 : kButton) | (power.Ok() ? 0 : kPower);
+    sei();
+    power_failures_ = 0;
+    power_failed_ = false;
+  }
+
+  // Interrupt handlers, called with interrupts disabled.
+  void ButtonIrq() {
+    if (!button.Get()) flags_ = flags_ | kButton;
+  }
+
+  void PowerIrq() {
+    if (!power.Ok()) flags_ = flags_ | kPower;
+  }
+
+  // Returns true if the motion should stop.
+  bool Poll() {
+    if (flags_ == 0) return false;
+    return Check();
+  }
+
+  // True if the run was stopped due to a power failure.
+  bool PowerFailed() const {
+    return power_failed_;
+  }
+
+ private:
+  static constexpr uint8_t kButton = 0x01;
+  static constexpr uint8_t kPower = 0x02;
+  static constexpr uint8_t kStopped = 0x80;
+
+  static constexpr uint8_t kMaxConsecutivePowerFailures = 2;
+
+  bool Check() {
+    if (flags_ & kStopped) return true;
+    cli();
+    bool pressed = !button.Get();
+    bool power_ok = power.Ok();
+    if (!pressed && power_ok) {
+      // Glitch, or power recovered in time.
+      flags_ = 0;
+      sei();
+      power_failures_ = 0;
+      return false;
+    }
+    sei();
+    if (!pressed && ++power_failures_ <= kMaxConsecutivePowerFailures) {
+      return false;
+    }
+    power_failed_ = !pressed;
+    flags_ = flags_ | kStopped;
+    return true;
+  }
+
+  volatile uint8_t flags_ = 0;
+  uint8_t power_failures_ = 0;
+  bool power_failed_ = false;
+};
+StopRequest stop_request;
+
+// Samples supply voltage in the background and adapts motion limits to it.
+// This class takes ownership of ADC0.
+class SupplyMonitor {
+ public:
+  static void Init() {
+    VREF.ADC0REF = VREF_REFSEL_1V024_gc;
+    ADC0.CTRLC = ADC_PRESC_DIV16_gc;  // 1MHz ADC clock
+    ADC0.SAMPCTRL = 16;  // longer sampling for the internal divider
+    ADC0.MUXPOS = ADC_MUXPOS_VDDDIV10_gc;
+    ADC0.CTRLA = ADC_ENABLE_bm;  // 12-bit, single conversion
+    ADC0.COMMAND = ADC_STCONV_bm;
+    driver.scheduler().Post(&Sample, nullptr, kPeriod);
+  }
+
+ private:
+  static constexpr uint32_t kPeriod = F_CPU / 10;  // 100ms
+
+  // Scheduler task: reads the last conversion and starts the next one.
+  static void Sample(void*) {
+    if (ADC0.INTFLAGS & ADC_RESRDY_bm) {
+      // VDD / 10 against 1.024V reference, 12 bits: 2.5mV per LSB.
+      uint16_t mv = (ADC0.RES * 5) / 2;
+      if (filtered_mv_ == 0) {
+        filtered_mv_ = mv;
+      } else {
+        // Filter out dips caused by the coil current.
+        filtered_mv_ = filtered_mv_ + (static_cast<int16_t>(mv) -
+                                       static_cast<int16_t>(filtered_mv_)) / 4;
+      }
+      driver.SetSupplyVoltage(filtered_mv_);
+    }
+    ADC0.COMMAND = ADC_STCONV_bm;
+    driver.scheduler().Post(&Sample, nullptr, kPeriod);
+  }
+
+  static inline uint16_t filtered_mv_ = 0;
+};
+
+CheckpointStore<kCheckpointSlots> checkpoints{kCheckpoints};
+
+StreamReceiver<Usart0, 128> stream;
 
 List unconnected_pins{
     StaticGpio<F, 0>(), StaticGpio<F, 1>(), StaticGpio<F, 3>(),
-    StaticGpio<F, 4>(), StaticGpio<F, 0>(), StaticGpio<A, 0>(),
-    StaticGpio<A, 1>(), StaticGpio<A, 2>(), StaticGpio<A, 3>(),
+    StaticGpio<F, 4>(), StaticGpio<F, 0>(), StaticGpio<A, 2>(),
+    StaticGpio<A, 3>(),
     StaticGpio<A, 4>(), StaticGpio<A, 5>()};
 
 struct UnconnectedPinInitFn {
@@ -298,17 +556,36 @@ struct UnconnectedPinInitFn {
 };
 
 // IRQ handlers
+ISR(TCB0_INT_vect) {
+  TCB0.INTFLAGS = TCB_CAPT_bm;  // Clear interrupt flag
+  Timer::Irq();
+}
+
 ISR(PORTD_PORT_vect) {
   PORTD.INTFLAGS = 0xff;  // Clear interrupt flag
+  stop_request.ButtonIrq();
   sei();
 }
 
 ISR(PORTA_PORT_vect) {
   PORTA.INTFLAGS = 0xff;  // Clear interrupt flag
-  sei();
   power.Irq();
+  stop_request.PowerIrq();
+  sei();
 }
 
+ISR(USART0_RXC_vect) {
+  stream.RxIrq(USART0.RXDATAL);
+}
+
+#if MICROSTEP
+ISR(TCB1_INT_vect) {
+  TCB1.INTFLAGS = TCB_CAPT_bm;  // Clear interrupt flag
+  left_coils.Tick();
+  right_coils.Tick();
+}
+#endif
+
 // Board init
 void BoardInit() {
   // Clock setup
@@ -321,8 +598,17 @@ void BoardInit() {
   // Use 2.85V as threshold.
   // BODCFG = 0x76;
 
+#if FLMAP_IMAGES
+  // Map flash section 1 with the image data into data space.
+  NVMCTRL.CTRLB =
+      (NVMCTRL.CTRLB & ~NVMCTRL_FLMAP_gm) | NVMCTRL_FLMAP_SECTION1_gc;
+#endif
+
   // Initialize peripherals
   Timer::Init();
+#if MICROSTEP
+  MicrostepTimer::Init();
+#endif
   left_eye.ConfigureOutput();
   right_eye.ConfigureOutput();
   button.ConfigureInput();
@@ -330,14 +616,16 @@ void BoardInit() {
   button.EnableDigitalInput(BothEdges);
   power.Init();
   kServoState.Init();
+  // Delays rely on the timer interrupt.
+  sei();
   driver.Init();
+  SupplyMonitor::Init();
+  Usart0::Init();
   // Route WO1 of TCA0 to gpio C1.
   PORTMUX.TCAROUTEA = 0x02;
 
   // Enable pullup on unconnected pins
   unconnected_pins.ForEach(UnconnectedPinInitFn());
-
-  sei();
 }
 
 // Sleep until button press.
@@ -367,14 +655,46 @@ void Sleep() {
 enum Mode {
   kCalibration,
   kTest,
-  kDrawImage
+  kDrawImage,
+  kStreamImage,
+  kResumeImage
 };
 
+// Period of checkpoints while drawing. A checkpoint is also saved when the
+// drawing is interrupted; the periodic ones cover resets and brown-outs.
+constexpr uint32_t kCheckpointPeriod = F_CPU * 10;  // 10s
+static_assert(kCheckpointPeriod < 0x80000000);
+
+// Draws menu entry `entry`: an image at paper size `variant`, or a generator
+// with `variant`.
+template <typename Interrupted, typename SaveProgress>
+bool DrawEntry(const Interrupted& interrupted, uint8_t entry, uint8_t variant,
+               DrawProgress* progress, const SaveProgress& save_progress) {
+  auto draw = [&](auto source) {
+    return driver.DrawImage(interrupted, &source, progress, save_progress);
+  };
+  if (entry <= kNumImages) {
+    return draw(Transformed(ImageReader(ReadImageData(&kImages[entry - 1])),
+                            kPaperSizes[(variant - 1) % kNumPaperSizes]));
+  }
+  switch (entry - kNumImages) {
+    case 1:
+      return draw(CurveSource(SpiralCurve(variant)));
+    case 2:
+      return draw(CurveSource(SpirographCurve(variant)));
+    case 3:
+      return draw(CurveSource(LissajousCurve(variant)));
+    default:
+      return draw(CurveSource(HilbertCurve(variant)));
+  }
+}
+
 int main() {
   BoardInit();
 
   BlinkNum(left_eye, 2);
   uint8_t img = 1;
+  uint8_t variant = 1;
   Mode mode;
 
   while(true) {
@@ -382,14 +702,43 @@ int main() {
 
     power.On();
     right_eye.Set(true);
-    while(!button.Get());
+    while(!button.Get()) Timer::Idle();
     right_eye.Set(false);
     // BlinkNum(left_eye, 3);
 
-    uint8_t sel = SelectNumber<Timer>(&left_eye, &button, 1, kNumImages, img);
-    if (sel <= kNumImages) {
+    // Images and generators are followed by streaming from the host and, if
+    // there is a checkpoint, by resuming the interrupted drawing. The resumed
+    // drawing restarts the checkpointed point, so the robot must be put back
+    // where that point started: after a stop request this is the point being
+    // drawn, after a reset the periodic checkpoint can be up to
+    // kCheckpointPeriod (10s of drawing) older.
+    constexpr uint8_t kStreamEntry = kNumDrawable + 1;
+    constexpr uint8_t kResumeEntry = kNumDrawable + 2;
+    Checkpoint checkpoint;
+    bool can_resume = checkpoints.Load(&checkpoint) &&
+                      checkpoint.image <= kNumDrawable;
+    uint8_t max = can_resume ? kResumeEntry : kStreamEntry;
+    uint8_t sel = SelectNumber<Timer>(&left_eye, &button, 1, max, img);
+    if (sel <= kNumDrawable) {
       img = sel;
       mode = kDrawImage;
+      // Paper size of an image, or variant of a generator.
+      uint8_t variants =
+          sel <= kNumImages ? kNumPaperSizes : kGeneratorVariants;
+      if (variant > variants) variant = 1;
+      BlinkNum(right_eye, sel);
+      variant = SelectNumber<Timer>(&left_eye, &button, 1, variants, variant);
+      if (variant > variants) {
+        variant = 1;
+        driver.Off();
+        power.Off();
+        continue;
+      }
+      sel = variant;
+    } else if (sel == kStreamEntry) {
+      mode = kStreamImage;
+    } else if (sel == kResumeEntry && can_resume) {
+      mode = kResumeImage;
     } else {
       driver.Off();
       power.Off();
@@ -397,19 +746,9 @@ int main() {
     }
     BlinkNum(right_eye, sel);
 
-    constexpr uint16_t kMaxConsecutivePowerFailures = 2;
-    uint16_t power_failures = 0;
-
+    stop_request.Arm();
     auto interrupted = [&]() {
-      if (!button.Get()) return true;
-      if (power_failures > kMaxConsecutivePowerFailures) return true;
-      if (!power.Ok()) {
-        power_failures++;
-      } else {
-        power_failures = 0;
-      }
-      if (power_failures > kMaxConsecutivePowerFailures) return true;
-      return false;
+      return stop_request.Poll();
     };
 
     switch(mode) {
@@ -420,22 +759,44 @@ int main() {
         driver.TestDrive(interrupted);
         break;
       case kDrawImage:
-        const Image* ptr;
-        memcpy_P(&ptr, &kImages[img - 1], sizeof(const Image*));
-        if (img == kNumImages) {
+      case kResumeImage: {
+        uint8_t drawn = img;
+        uint8_t drawn_variant = variant;
+        DrawProgress progress{};
+        if (mode == kResumeImage) {
+          drawn = checkpoint.image;
+          drawn_variant = checkpoint.variant;
+          progress = checkpoint.progress;
+        }
+        if (drawn == kNumDrawable) {
           img = 1;
         } else {
-          img++;
+          img = drawn + 1;
+        }
+        uint32_t last_save = Timer::GetTime32();
+        auto save_progress = [&](const DrawProgress& p, bool force) {
+          uint32_t now = Timer::GetTime32();
+          if (!force && now - last_save < kCheckpointPeriod) return;
+          last_save = now;
+          checkpoints.Save(drawn, drawn_variant, p);
+        };
+        if (DrawEntry(interrupted, drawn, drawn_variant, &progress,
+                      save_progress)) {
+          checkpoints.Clear();
         }
-        driver.DrawImage(interrupted, ptr);
+        break;
+      }
+      case kStreamImage:
+        stream.Start();
+        driver.DrawStream(interrupted, &stream);
         break;
     }
 
-    if (power_failures > kMaxConsecutivePowerFailures) {
+    if (stop_request.PowerFailed()) {
       BlinkNum(right_eye, 7);
     }
 
-    while(!button.Get());
+    while(!button.Get()) Timer::Idle();
     BlinkNum(left_eye, 3);
 
     driver.Off();
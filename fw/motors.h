@@ -27,7 +27,13 @@ concept IsStepper = requires(T t, int8_t i8) {
   { t.Move(i8) } -> std::same_as<void>;
 };
 
-// Stepper, working in half-step mode.
+// Optional stepper extension: switchable full-step drive.
+template <typename T>
+concept HasFullStep = IsStepper<T> && requires(T t, bool b) {
+  { t.SetFullStep(b) } -> std::same_as<void>;
+};
+
+// Stepper, working in half-step mode, optionally in full-step mode.
 // C: List<> of gpio pins driving the coils of the stepper motor.
 template <typename C>
 class Stepper {
@@ -36,21 +42,39 @@ class Stepper {
 
   void Init() {
     c_.ForEach(InitFn());
-    c_.ForEach(OffFn());
+    Off();
   }
 
   void Off() {
     c_.ForEach(OffFn());
+    out_ = kOff;
   }
 
   void Move(int8_t delta) {
     pos_ += delta;
     pos_ = (pos_ + kPeriod) % kPeriod;
 
-    c_.ForEach(UpdateFn(kPeriod, pos_));
+    Update();
+  }
+
+  // Full-step mode drives only the two-coil positions (odd half-steps), which
+  // gives more torque at speed and half the coil switching rate. Position is
+  // still tracked in half-steps and the output rounds it up to the next odd
+  // position, so the rotor is at most one half-step ahead and switching modes
+  // in either direction keeps the phase.
+  void SetFullStep(bool full_step) {
+    full_step_ = full_step;
+    if (out_ != kOff) Update();
   }
 
  private:
+  void Update() {
+    uint8_t out = full_step_ ? (pos_ | 1) : pos_;
+    if (out == out_) return;
+    out_ = out;
+    c_.ForEach(UpdateFn(kPeriod, out));
+  }
+
   struct InitFn {
     template <typename T>
     void operator()(T& c, uint8_t) const {
@@ -79,10 +103,177 @@ class Stepper {
 
   [[no_unique_address]] C c_;
   constexpr static int kPeriod = 2 * C::Len();
+  constexpr static uint8_t kOff = 0xff;  // `out_` when coils are off
   uint8_t pos_ = 0;
+  uint8_t out_ = kOff;  // position currently driven on the coils
+  bool full_step_ = false;
 };
 static_assert(
-    IsStepper<
+    HasFullStep<
         Stepper<List<DynamicGpio, DynamicGpio, DynamicGpio, DynamicGpio>>>);
 
+// Microstepping stepper, driving the coils with software PWM.
+//
+// PwmCoils owns the coils and does the PWM; its Tick() has to be called from a
+// timer interrupt at kLevels times the PWM frequency. MicroStepper is a handle
+// implementing the stepper interface, so it can be passed to Driver.
+//
+// Move() sets the target position in half-steps. The interrupt advances the
+// driven position towards it one microstep at a time, spreading the microsteps
+// over the interval between the last two position changes. Coil currents
+// follow the cosine of the distance from the coil, which keeps the torque
+// constant between half-step positions.
+//
+// C: List<> of gpio pins driving the coils of the stepper motor.
+// kMicrosteps: microsteps per half-step.
+// kLevels: PWM resolution, interrupts per PWM period.
+template <typename C, uint8_t kMicrosteps, uint8_t kLevels>
+class PwmCoils {
+ public:
+  PwmCoils(C c) : c_(std::move(c)) {}
+
+  void Init() {
+    c_.ForEach(InitFn());
+    Off();
+  }
+
+  void Off() {
+    on_ = false;
+    c_.ForEach(OffFn());
+  }
+
+  // Called from the main loop only.
+  void Move(int8_t delta) {
+    target_ = (target_ + kPeriod + delta * kMicrosteps) % kPeriod;
+    on_ = true;
+  }
+
+  // Called from the timer interrupt only.
+  void Tick() {
+    if (!on_) return;
+    if (ticks_ < 0xffff) ticks_++;
+
+    if (target_ != last_target_) {
+      // Target moved by a half-step, spread the next one over the same time.
+      interval_ = ticks_ / kMicrosteps;
+      if (interval_ == 0) interval_ = 1;
+      ticks_ = 0;
+      last_target_ = target_;
+    }
+
+    int8_t diff = target_ - pos_;
+    if (diff >= kPeriod / 2) {
+      diff -= kPeriod;
+    } else if (diff < -kPeriod / 2) {
+      diff += kPeriod;
+    }
+    if (diff != 0 && (++wait_ >= interval_ || diff > kMicrosteps ||
+                      diff < -kMicrosteps)) {
+      wait_ = 0;
+      pos_ = (pos_ + kPeriod + (diff > 0 ? 1 : -1)) % kPeriod;
+      for (uint8_t i = 0; i < C::Len(); ++i) {
+        uint8_t d = (pos_ + kPeriod - 2 * kMicrosteps * i) % kPeriod;
+        if (d > kPeriod / 2) d = kPeriod - d;
+        duty_[i] = d < kTableLen ? kDuty[d] : 0;
+      }
+    }
+
+    if (++phase_ >= kLevels) phase_ = 0;
+    c_.ForEach(PwmFn(duty_, phase_));
+  }
+
+ private:
+  struct InitFn {
+    template <typename T>
+    void operator()(T& c, uint8_t) const {
+      c.ConfigureOutput();
+    }
+  };
+
+  struct OffFn {
+    template <typename T>
+    void operator()(T& c, uint8_t) const {
+      c.Set(false);
+    }
+  };
+
+  struct PwmFn {
+    PwmFn(const uint8_t* duty_, uint8_t phase_) : duty(duty_), phase(phase_) {}
+
+    template <typename T>
+    void operator()(T& c, uint8_t i) const {
+      c.Set(duty[i] > phase);
+    }
+
+    const uint8_t* duty;
+    uint8_t phase;
+  };
+
+  static constexpr float Cos(float x) {
+    // Taylor series, good enough for 0 <= x <= pi / 2.
+    float x2 = x * x;
+    float term = 1;
+    float sum = 1;
+    for (int i = 1; i < 10; ++i) {
+      term *= -x2 / ((2 * i - 1) * (2 * i));
+      sum += term;
+    }
+    return sum;
+  }
+
+  // Coil is energised within two half-steps from its position.
+  static constexpr uint8_t kTableLen = 2 * kMicrosteps;
+
+  struct DutyTable {
+    constexpr DutyTable() : v() {
+      for (uint8_t d = 0; d < kTableLen; ++d) {
+        v[d] = static_cast<uint8_t>(
+            kLevels * Cos(3.14159265f / 4 * d / kMicrosteps) + 0.5f);
+      }
+    }
+    uint8_t v[kTableLen];
+  };
+  static constexpr uint8_t kPeriod = 2 * C::Len() * kMicrosteps;
+  static_assert(kPeriod < 128);
+  static constexpr DutyTable kDutyTable{};
+  static constexpr const uint8_t* kDuty = kDutyTable.v;
+
+  [[no_unique_address]] C c_;
+  volatile bool on_ = false;
+  volatile uint8_t target_ = 0;  // microsteps, written by Move()
+
+  // State of the interrupt.
+  uint8_t pos_ = 0;  // microsteps
+  uint8_t last_target_ = 0;
+  uint8_t phase_ = 0;
+  uint8_t duty_[C::Len()] = {kLevels};
+  uint16_t wait_ = 0;  // ticks since the last microstep
+  uint16_t interval_ = 1;  // ticks per microstep
+  uint16_t ticks_ = 0;  // ticks since last target change
+};
+
+template <typename Coils>
+class MicroStepper {
+ public:
+  MicroStepper(Coils* coils) : coils_(coils) {}
+
+  void Init() {
+    coils_->Init();
+  }
+
+  void Off() {
+    coils_->Off();
+  }
+
+  void Move(int8_t delta) {
+    coils_->Move(delta);
+  }
+
+ private:
+  Coils* coils_;
+};
+static_assert(IsStepper<MicroStepper<
+        PwmCoils<List<DynamicGpio, DynamicGpio, DynamicGpio, DynamicGpio>,
+                 8, 16>>>);
+
 #endif  // MOTORS_H_
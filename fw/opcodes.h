@@ -0,0 +1,23 @@
+#ifndef OPCODES_H_
+#define OPCODES_H_
+
+#include <stdint.h>
+
+// Control opcodes in the DataPoint array of an Image. Shared by the firmware
+// and the host tools, so it depends on stdint.h only.
+//
+// An opcode takes two DataPoints: { kOpcodeMarker, opcode, 0 } and its
+// argument. A len of kOpcodeMarker never occurs in a move.
+//
+//   kOpCall: argument { start, count, 0 }. Executes `count` entries of the
+//     array starting at index `start`, then continues after the call. Calls
+//     nest up to kMaxCallDepth.
+//   kOpRepeat: argument { n, 0, 0 }. The following call is executed n times.
+
+constexpr int16_t kOpcodeMarker = -0x7fff - 1;
+constexpr int16_t kOpCall = 1;
+constexpr int16_t kOpRepeat = 2;
+
+constexpr uint8_t kMaxCallDepth = 4;
+
+#endif  // OPCODES_H_
@@ -0,0 +1,87 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdint.h>
+
+#include "stl.h"
+#include "utils.h"
+
+// Cooperative scheduler of short tasks.
+//
+// Tasks are kept in a fixed-size array ordered by deadline. RunDue() runs the
+// tasks whose deadline passed and is cheap when nothing is due, so it is called
+// from the busy loops (motion, delays). A task runs to completion; periodic
+// tasks post themselves again.
+//
+// Timer: timer providing 32-bit time.
+// kMaxTasks: maximum number of scheduled tasks.
+template <typename Timer, uint8_t kMaxTasks>
+requires HasTime32<Timer>
+class Scheduler {
+ public:
+  using TaskFn = void (*)(void* context);
+
+  // Schedules `fn` to run `delay` timer ticks from now. A task already
+  // scheduled with the same `fn` and `context` is rescheduled. Returns false
+  // if there is no free slot.
+  bool Post(TaskFn fn, void* context, uint32_t delay = 0) {
+    Cancel(fn, context);
+    if (num_tasks_ == kMaxTasks) return false;
+    uint32_t now = Timer::GetTime32();
+    uint32_t deadline = now + delay;
+    uint8_t i = num_tasks_;
+    // Keep the array ordered by deadline, FIFO for equal deadlines.
+    while (i > 0 &&
+           static_cast<int32_t>(tasks_[i - 1].deadline - now) >
+               static_cast<int32_t>(delay)) {
+      tasks_[i] = tasks_[i - 1];
+      --i;
+    }
+    tasks_[i] = Task{deadline, fn, context};
+    num_tasks_++;
+    return true;
+  }
+
+  // Removes the task, if it is scheduled.
+  void Cancel(TaskFn fn, void* context) {
+    for (uint8_t i = 0; i < num_tasks_; ++i) {
+      if (tasks_[i].fn == fn && tasks_[i].context == context) {
+        Remove(i);
+        return;
+      }
+    }
+  }
+
+  // Runs all tasks due at time `now`.
+  void RunDue(uint32_t now) {
+    while (num_tasks_ > 0 &&
+           static_cast<int32_t>(now - tasks_[0].deadline) >= 0) {
+      Task t = tasks_[0];
+      Remove(0);
+      t.fn(t.context);
+    }
+  }
+
+  void RunDue() {
+    if (num_tasks_ > 0) RunDue(Timer::GetTime32());
+  }
+
+ private:
+  struct Task {
+    uint32_t deadline;
+    TaskFn fn;
+    void* context;
+  };
+
+  void Remove(uint8_t i) {
+    num_tasks_--;
+    for (; i < num_tasks_; ++i) {
+      tasks_[i] = tasks_[i + 1];
+    }
+  }
+
+  Task tasks_[kMaxTasks];
+  uint8_t num_tasks_ = 0;
+};
+
+#endif  // SCHEDULER_H_
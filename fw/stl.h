@@ -29,6 +29,12 @@
 #ifndef STL_H_
 #define STL_H_
 
+#ifndef __AVR__
+// Host builds of the firmware (tests) use the standard library of the host.
+#include <concepts>
+#include <utility>
+#else
+
 namespace std {
   using size_t = uint8_t;
   /**
@@ -3558,4 +3564,6 @@ template<typename _Tp>
 
 } // namespace
 
+#endif  // __AVR__
+
 #endif  // STL_H_
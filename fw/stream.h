@@ -0,0 +1,158 @@
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include <avr/interrupt.h>
+#include <stdint.h>
+
+#include "driver.h"
+#include "stl.h"
+#include "stream_protocol.h"
+
+// Uart used by StreamReceiver for sending, receiving is done by the interrupt.
+template <typename T>
+concept IsUart = requires(uint8_t b) {
+  { T::CanWrite() } -> std::same_as<bool>;
+  { T::Write(b) } -> std::same_as<void>;
+};
+
+// Receives a stream of DataPoints from the host, see stream_protocol.h.
+//
+// RxIrq() parses the frames in the receive interrupt straight into a ring
+// buffer, Pop() takes the points in the main loop. Answers and free space
+// reports are queued and sent by Poll() when the uart is free, so neither side
+// blocks.
+//
+// Uart: uart to send the answers.
+// kCapacity: buffer size in points, power of 2, at most 128.
+template <typename Uart, uint8_t kCapacity>
+requires IsUart<Uart>
+class StreamReceiver {
+  static_assert(kCapacity >= kStreamMaxFramePoints && kCapacity <= 128 &&
+                (kCapacity & (kCapacity - 1)) == 0);
+
+ public:
+  // Starts a new stream, grants the whole buffer to the host.
+  void Start() {
+    cli();
+    head_ = 0;
+    tail_ = 0;
+    end_ = false;
+    sequence_ = 0;
+    answer_ = 0;
+    report_ = true;
+    state_ = kWaitStart;
+    sei();
+    polls_ = 0;
+  }
+
+  // Takes the next point. Returns false if none was received yet.
+  bool Pop(DataPoint* p) {
+    if (tail_ == head_) return false;
+    // Read the point only after head_.
+    __asm__ __volatile__("" ::: "memory");
+    *p = buffer_[tail_ % kCapacity];
+    tail_++;
+    report_ = true;
+    return true;
+  }
+
+  // The host ended the stream and all points were taken.
+  bool Done() const {
+    return end_ && tail_ == head_;
+  }
+
+  // Sends queued answers and the free space, at least every kReportPolls
+  // calls.
+  void Poll() {
+    if (answer_ != 0 && Uart::CanWrite()) {
+      Uart::Write(answer_);
+      answer_ = 0;
+    }
+    if (++polls_ >= kReportPolls) report_ = true;
+    if (answer_ == 0 && report_ && Uart::CanWrite()) {
+      report_ = false;
+      polls_ = 0;
+      uint8_t free = kCapacity - static_cast<uint8_t>(head_ - tail_);
+      Uart::Write(free > kStreamMaxFree ? kStreamMaxFree : free);
+    }
+  }
+
+  // Called from the receive interrupt.
+  void RxIrq(uint8_t b) {
+    switch (state_) {
+      case kWaitStart:
+        if (b == kStreamFrameStart) state_ = kCount;
+        break;
+      case kCount: {
+        count_ = b & ~kStreamSequenceBit;
+        frame_sequence_ = b & kStreamSequenceBit;
+        uint8_t free = kCapacity - static_cast<uint8_t>(head_ - tail_);
+        // Repeated frame was stored already, only acknowledge it again. Its
+        // points may fill the buffer, so it cannot overflow.
+        repeated_ = frame_sequence_ != sequence_;
+        overflow_ = !repeated_ && count_ > free;
+        sum_ = StreamChecksum(0, b);
+        pos_ = 0;
+        state_ = count_ == 0 ? kChecksum : kData;
+        if (count_ > kStreamMaxFramePoints) {
+          answer_ = kStreamNak;
+          state_ = kWaitStart;
+        }
+        break;
+      }
+      case kData:
+        if (!repeated_ && !overflow_) {
+          uint8_t i = head_ + pos_ / kStreamPointSize;
+          reinterpret_cast<uint8_t*>(
+              &buffer_[i % kCapacity])[pos_ % kStreamPointSize] = b;
+        }
+        sum_ = StreamChecksum(sum_, b);
+        if (++pos_ == count_ * kStreamPointSize) state_ = kChecksum;
+        break;
+      case kChecksum:
+        if (b != sum_ || overflow_) {
+          answer_ = kStreamNak;
+        } else {
+          if (!repeated_) {
+            head_ = head_ + count_;
+            if (count_ == 0) end_ = true;
+            sequence_ ^= kStreamSequenceBit;
+          }
+          answer_ = kStreamAck | (frame_sequence_ ? kStreamAckSequence : 0);
+        }
+        report_ = true;
+        state_ = kWaitStart;
+        break;
+    }
+  }
+
+ private:
+  enum State : uint8_t { kWaitStart, kCount, kData, kChecksum };
+
+  // Layout of the points in a frame matches DataPoint.
+  static_assert(sizeof(DataPoint) == kStreamPointSize);
+
+  // Free space is reported at least this often, 100ms with the poller of
+  // Driver::DrawStream.
+  static constexpr uint8_t kReportPolls = 100;
+
+  DataPoint buffer_[kCapacity];
+  volatile uint8_t head_ = 0;  // written by the interrupt
+  uint8_t tail_ = 0;
+  volatile bool end_ = false;
+  volatile uint8_t answer_ = 0;  // to be sent, 0 if none
+  volatile bool report_ = false;  // free space to be sent
+  uint8_t polls_ = 0;  // since the last report
+
+  // State of the interrupt.
+  State state_ = kWaitStart;
+  uint8_t sequence_ = 0;  // sequence bit of the next new frame
+  uint8_t frame_sequence_ = 0;
+  uint8_t count_ = 0;
+  uint8_t pos_ = 0;  // byte in the frame data
+  uint8_t sum_ = 0;
+  bool repeated_ = false;
+  bool overflow_ = false;
+};
+
+#endif  // STREAM_H_
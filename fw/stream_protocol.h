@@ -0,0 +1,54 @@
+#ifndef STREAM_PROTOCOL_H_
+#define STREAM_PROTOCOL_H_
+
+#include <stdint.h>
+
+// Protocol for streaming DataPoints from a host over UART. Shared by the
+// firmware and the host tools, so it depends on stdint.h only.
+//
+// Host to robot, frames:
+//   kStreamFrameStart, count, count * 4 bytes of points, checksum
+// count holds the number of points (at most kStreamMaxFramePoints) in the low
+// bits and the frame sequence bit in kStreamSequenceBit. A frame with zero
+// points ends the stream. Points are encoded as the DataPoint in AVR memory:
+// len (little endian), then angle in the low 15 bits and pen in the top bit.
+//
+// Robot to host, single bytes:
+//   0 - kStreamMaxFree: free space, number of free points in the receive
+//     buffer (larger space is reported as kStreamMaxFree)
+//   kStreamAck: last frame accepted, with kStreamAckSequence set if the frame
+//     had the sequence bit set
+//   kStreamNak: last frame rejected, resend it
+//
+// The robot reports its free space when the stream starts, after each answer,
+// as it draws the points, and periodically. Reports are absolute, so a lost or
+// corrupted one is corrected by the next. The host may send as many points as
+// the last report allows, less the points of its unacknowledged frame, and
+// keeps at most one frame unacknowledged. If the frame is rejected or no answer
+// comes, the host resends the identical frame. The robot acknowledges a
+// repeated frame without storing it again, even if its points no longer fit.
+
+constexpr uint8_t kStreamFrameStart = 0x55;
+constexpr uint8_t kStreamMaxFramePoints = 16;
+constexpr uint8_t kStreamSequenceBit = 0x80;
+constexpr uint8_t kStreamPointSize = 4;
+
+constexpr uint8_t kStreamMaxFree = 0x7f;
+constexpr uint8_t kStreamAck = 0x80;
+constexpr uint8_t kStreamNak = 0x81;
+constexpr uint8_t kStreamAckSequence = 0x02;
+
+// Checksum of the count byte and the points.
+inline uint8_t StreamChecksum(uint8_t sum, uint8_t byte) {
+  return sum + byte;
+}
+
+inline void StreamEncodePoint(int16_t len, int16_t angle, bool pen,
+                              uint8_t* out) {
+  out[0] = len & 0xff;
+  out[1] = (len >> 8) & 0xff;
+  out[2] = angle & 0xff;
+  out[3] = ((angle >> 8) & 0x7f) | (pen ? 0x80 : 0);
+}
+
+#endif  // STREAM_PROTOCOL_H_
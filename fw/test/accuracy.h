@@ -0,0 +1,207 @@
+#ifndef ACCURACY_H_
+#define ACCURACY_H_
+
+// Compares the trace of a simulated drawing with the lines the image asks for.
+// Lengths are in meters.
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../driver.h"
+
+namespace testing {
+
+// Position of the robot. Drawings start at the origin, heading up.
+struct Point {
+  double x = 0.0;
+  double y = 0.0;
+  double alpha = M_PI / 2.0;
+  bool pendown = true;
+};
+
+struct Segment {
+  double x0;
+  double y0;
+  double x1;
+  double y1;
+};
+
+// Geometry of the robot, same as in gendata.
+constexpr double kStepLength = M_PI * 0.0505 / 4096;
+constexpr double kStepAngle = 2.0 * kStepLength / 0.0772;  // radians
+
+// The pen-down lines of the points of `source`.
+template <typename Source>
+requires IsImageSource<Source>
+std::vector<Segment> IntendedSegments(Source source) {
+  std::vector<Segment> segments;
+  Point p;
+  DataPoint d;
+  while (source.Next(&d)) {
+    p.alpha -= d.angle * kStepAngle;
+    double x = p.x + cos(p.alpha) * d.len * kStepLength;
+    double y = p.y + sin(p.alpha) * d.len * kStepLength;
+    if (d.pen && d.len != 0) segments.push_back({p.x, p.y, x, y});
+    p.x = x;
+    p.y = y;
+  }
+  return segments;
+}
+
+// The pen-down lines of a trace, drawn the same way as DrawingSim shows them.
+inline std::vector<Segment> TraceSegments(const std::vector<Point>& trace) {
+  std::vector<Segment> segments;
+  Point prev;
+  for (const Point& p : trace) {
+    if (prev.pendown && p.pendown && (p.x != prev.x || p.y != prev.y)) {
+      segments.push_back({prev.x, prev.y, p.x, p.y});
+    }
+    prev = p;
+  }
+  return segments;
+}
+
+// Finds the nearest of a set of segments. Segments are stored in each cell of
+// a uniform grid they cross, and a query visits rings of cells around the point
+// until no closer segment can be found.
+class SegmentGrid {
+ public:
+  SegmentGrid(const std::vector<Segment>& segments, double cell)
+      : segments_(segments), cell_(cell) {
+    if (segments_.empty()) return;
+    x0_ = std::min(segments_[0].x0, segments_[0].x1);
+    y0_ = std::min(segments_[0].y0, segments_[0].y1);
+    double x1 = x0_;
+    double y1 = y0_;
+    for (const Segment& s : segments_) {
+      x0_ = std::min({x0_, s.x0, s.x1});
+      y0_ = std::min({y0_, s.y0, s.y1});
+      x1 = std::max({x1, s.x0, s.x1});
+      y1 = std::max({y1, s.y0, s.y1});
+    }
+    nx_ = static_cast<int>((x1 - x0_) / cell_) + 1;
+    ny_ = static_cast<int>((y1 - y0_) / cell_) + 1;
+    cells_.resize(nx_ * ny_);
+    for (size_t i = 0; i < segments_.size(); ++i) {
+      const Segment& s = segments_[i];
+      // Cells of the bounding box of the segment, which are few for segments
+      // short compared to the cell.
+      int cx0 = CellX(std::min(s.x0, s.x1));
+      int cx1 = CellX(std::max(s.x0, s.x1));
+      int cy0 = CellY(std::min(s.y0, s.y1));
+      int cy1 = CellY(std::max(s.y0, s.y1));
+      for (int cy = cy0; cy <= cy1; ++cy) {
+        for (int cx = cx0; cx <= cx1; ++cx) {
+          if (Distance(s, (cx + 0.5) * cell_ + x0_, (cy + 0.5) * cell_ + y0_) <=
+              cell_ * M_SQRT1_2) {
+            cells_[cy * nx_ + cx].push_back(i);
+          }
+        }
+      }
+    }
+  }
+
+  // Distance from (x, y) to the nearest segment, INFINITY if there are none.
+  double Distance(double x, double y) const {
+    double best = INFINITY;
+    if (segments_.empty()) return best;
+    int cx = static_cast<int>(floor((x - x0_) / cell_));
+    int cy = static_cast<int>(floor((y - y0_) / cell_));
+    // Rings beyond this one are outside of the grid.
+    int max_ring = std::max({cx, nx_ - 1 - cx, cy, ny_ - 1 - cy});
+    for (int r = 0; r <= max_ring; ++r) {
+      for (int gy = cy - r; gy <= cy + r; ++gy) {
+        if (gy < 0 || gy >= ny_) continue;
+        // Only the border of the ring.
+        int step = (gy == cy - r || gy == cy + r) ? 1 : std::max(2 * r, 1);
+        for (int gx = cx - r; gx <= cx + r; gx += step) {
+          if (gx < 0 || gx >= nx_) continue;
+          for (size_t i : cells_[gy * nx_ + gx]) {
+            best = std::min(best, Distance(segments_[i], x, y));
+          }
+        }
+      }
+      // Points in the next rings are at least r cells away.
+      if (best <= r * cell_) break;
+    }
+    return best;
+  }
+
+  static double Distance(const Segment& s, double x, double y) {
+    double dx = s.x1 - s.x0;
+    double dy = s.y1 - s.y0;
+    double len2 = dx * dx + dy * dy;
+    double t = len2 == 0.0 ? 0.0 : ((x - s.x0) * dx + (y - s.y0) * dy) / len2;
+    t = std::clamp(t, 0.0, 1.0);
+    return hypot(s.x0 + t * dx - x, s.y0 + t * dy - y);
+  }
+
+ private:
+  int CellX(double x) const {
+    return std::clamp(static_cast<int>((x - x0_) / cell_), 0, nx_ - 1);
+  }
+
+  int CellY(double y) const {
+    return std::clamp(static_cast<int>((y - y0_) / cell_), 0, ny_ - 1);
+  }
+
+  const std::vector<Segment>& segments_;
+  double cell_;
+  double x0_ = 0.0;
+  double y0_ = 0.0;
+  int nx_ = 0;
+  int ny_ = 0;
+  std::vector<std::vector<size_t>> cells_;
+};
+
+struct Accuracy {
+  double hausdorff;  // largest distance of a line from the other drawing
+  double mean;  // mean distance of the drawn lines from the intended ones
+};
+
+// Compares the lines at points spaced by `sample` along them.
+inline Accuracy CompareDrawings(const std::vector<Segment>& intended,
+                                const std::vector<Segment>& drawn,
+                                double sample = 0.0002) {
+  constexpr double kCell = 0.005;
+  SegmentGrid intended_grid(intended, kCell);
+  SegmentGrid drawn_grid(drawn, kCell);
+  // Calls f(x, y, weight) for the samples of `segments`.
+  auto for_samples = [&](const std::vector<Segment>& segments, auto f) {
+    for (const Segment& s : segments) {
+      double len = hypot(s.x1 - s.x0, s.y1 - s.y0);
+      int n = static_cast<int>(ceil(len / sample));
+      for (int i = 0; i <= n; ++i) {
+        double t = n == 0 ? 0.0 : static_cast<double>(i) / n;
+        f(s.x0 + t * (s.x1 - s.x0), s.y0 + t * (s.y1 - s.y0),
+          n == 0 ? 0.0 : len / (n + 1));
+      }
+    }
+  };
+
+  Accuracy result{0.0, 0.0};
+  if (intended.empty() && drawn.empty()) return result;
+  double length = 0.0;
+  for_samples(drawn, [&](double x, double y, double weight) {
+    double d = intended_grid.Distance(x, y);
+    result.hausdorff = std::max(result.hausdorff, d);
+    result.mean += d * weight;
+    length += weight;
+  });
+  for_samples(intended, [&](double x, double y, double) {
+    result.hausdorff = std::max(result.hausdorff, drawn_grid.Distance(x, y));
+  });
+  result.mean = length > 0.0 ? result.mean / length : result.hausdorff;
+  return result;
+}
+
+// Drawings of the runner tests must not be further than these from their
+// images, about twice the largest deviations runner_host_test prints.
+constexpr double kMaxHausdorff = 0.002;  // 2mm
+constexpr double kMaxMeanDeviation = 0.0001;  // 0.1mm
+
+}  // namespace testing
+
+#endif  // ACCURACY_H_
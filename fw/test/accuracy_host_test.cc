@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "accuracy.h"
+
+namespace testing {
+
+struct VectorSource {
+  bool Next(DataPoint* p) {
+    if (next == points.size()) return false;
+    *p = points[next++];
+    return true;
+  }
+
+  std::vector<DataPoint> points;
+  size_t next = 0;
+};
+
+DataPoint Move(int16_t len, int16_t angle, bool pen) {
+  DataPoint p;
+  p.len = len;
+  p.angle = angle;
+  p.pen = pen;
+  return p;
+}
+
+TEST(AccuracyTest, IntendedSegments) {
+  // A square with 1000 step sides, the second side without the pen.
+  int16_t quarter = static_cast<int16_t>(M_PI / 2 / kStepAngle + 0.5);
+  std::vector<Segment> s = IntendedSegments(VectorSource{{
+      Move(1000, 0, true), Move(1000, quarter, false),
+      Move(1000, quarter, true), Move(1000, quarter, true)}});
+  ASSERT_EQ(s.size(), 3u);
+  double side = 1000 * kStepLength;
+  // Starts up, positive angles turn right.
+  EXPECT_NEAR(s[0].x1, 0.0, 1e-9);
+  EXPECT_NEAR(s[0].y1, side, 1e-9);
+  EXPECT_NEAR(s[1].x0, side, 1e-4);
+  EXPECT_NEAR(s[1].y1, 0.0, 1e-4);
+  EXPECT_NEAR(s[2].x1, 0.0, 1e-4);
+  EXPECT_NEAR(s[2].y1, 0.0, 1e-4);
+}
+
+TEST(AccuracyTest, TraceSegments) {
+  std::vector<Point> trace = {
+    {.x = 0.0, .y = 0.01, .pendown = true},
+    {.x = 0.0, .y = 0.02, .pendown = false},
+    {.x = 0.01, .y = 0.02, .pendown = true},
+    {.x = 0.02, .y = 0.02, .pendown = true},
+  };
+  std::vector<Segment> s = TraceSegments(trace);
+  ASSERT_EQ(s.size(), 2u);
+  EXPECT_EQ(s[0].y1, 0.01);
+  EXPECT_EQ(s[1].x0, 0.01);
+  EXPECT_EQ(s[1].x1, 0.02);
+}
+
+TEST(AccuracyTest, Compare) {
+  std::vector<Segment> line = {{0.0, 0.0, 0.1, 0.0}};
+  Accuracy same = CompareDrawings(line, line);
+  EXPECT_NEAR(same.hausdorff, 0.0, 1e-12);
+  EXPECT_NEAR(same.mean, 0.0, 1e-12);
+
+  Accuracy shifted = CompareDrawings(line, {{0.0, 0.001, 0.1, 0.001}});
+  EXPECT_NEAR(shifted.hausdorff, 0.001, 1e-9);
+  EXPECT_NEAR(shifted.mean, 0.001, 1e-9);
+
+  // Only half of the line is drawn, but exactly.
+  Accuracy half = CompareDrawings(line, {{0.0, 0.0, 0.05, 0.0}});
+  EXPECT_NEAR(half.hausdorff, 0.05, 1e-9);
+  EXPECT_NEAR(half.mean, 0.0, 1e-12);
+
+  EXPECT_EQ(CompareDrawings(line, {}).hausdorff, INFINITY);
+}
+
+TEST(AccuracyTest, GridMatchesBruteForce) {
+  srand(1);
+  auto random = [](double range) { return range * rand() / RAND_MAX; };
+  std::vector<Segment> segments;
+  for (int i = 0; i < 200; ++i) {
+    double x = random(0.3);
+    double y = random(0.4);
+    segments.push_back({x, y, x + random(0.02) - 0.01,
+                        y + random(0.02) - 0.01});
+  }
+  SegmentGrid grid(segments, 0.005);
+  for (int i = 0; i < 1000; ++i) {
+    // Also outside of the segments.
+    double x = random(0.5) - 0.1;
+    double y = random(0.6) - 0.1;
+    double best = INFINITY;
+    for (const Segment& s : segments) {
+      best = std::min(best, SegmentGrid::Distance(s, x, y));
+    }
+    EXPECT_EQ(grid.Distance(x, y), best);
+  }
+}
+
+}  // namespace testing
@@ -0,0 +1,162 @@
+#ifndef AVR_BOARD_H_
+#define AVR_BOARD_H_
+
+// Simulated robot for the firmware of the tests. Motors, servo and time are
+// exchanged with the host (avr_test.h) through the variables below.
+
+#include <avr/io.h>
+
+#include "avr_mcu_section.h"
+
+// There are multiple problems with AVR_MCU macro (section is dropped by
+// linker, it uses 'string' as designator, which gcc does not like.)
+// AVR_MCU(F_CPU, "atmega328");
+
+#define MMCU __attribute__((used,section(".mmcu")))
+const struct avr_mmcu_string_t _AVR_MMCU_TAG_NAME MMCU = {
+        AVR_MMCU_TAG_NAME,
+        sizeof(struct avr_mmcu_string_t) - 2,
+        "atmega328",
+};
+
+#define USED __attribute__((used))
+
+#include "../driver.h"
+
+// Input: To be updated by host
+volatile uint32_t cycle_count USED;
+
+// Output: To be filled by this code (simulated AVR)
+volatile uint8_t state USED;
+
+// This is used to guarante atomic reads from cycle_count.
+volatile bool cycle_count_lock USED = false;
+
+// Tells the host that the outputs below are about to change, see
+// AvrSim::SetEventMode. The host brings the physics up to date with the old
+// outputs first.
+inline void NotifyHost() {
+  GPIOR0 = 1;
+}
+
+volatile bool servo_on USED = false;
+volatile uint16_t servo_state USED;
+
+constexpr int kNumCoils = 4;
+volatile bool left_coils[kNumCoils] USED;
+volatile int32_t left_steps;
+volatile bool right_coils[kNumCoils] USED;
+volatile int32_t right_steps;
+
+CalibrationData kCalibrationData EEMEM {
+  .angle_offset = 0,
+  .left_fraction = 1 << 14,
+  .right_fraction = 1 << 14,
+  .pen_down = 1400,
+  .pen_up = 800,
+  .limits = {
+    // kDrawMove
+    {
+      .max_v = 750,  // steps/s
+      .max_a = 7500,  // 0 to max_v in 100ms
+      .max_j = 0,  // trapezoidal profile
+    },
+    // kTravelMove
+    {
+      .max_v = 750,
+      .max_a = 7500,
+      .max_j = 0,
+    },
+    // kRotateMove
+    {
+      .max_v = 750,
+      .max_a = 7500,
+      .max_j = 0,
+    },
+  },
+  .supply = {
+    .mv = {2900, 3100, 3300, 3600},
+    .scale = {128, 128, 128, 128},
+  },
+  .coil_settle_ms = 0,
+};
+// Tests write it with AvrCalibrationBytes() (host_board.h).
+static_assert(sizeof(CalibrationData) == 47);
+
+struct Timer {
+  static void Init() {}
+  static uint16_t GetTime() {
+    cycle_count_lock = true;
+    uint16_t retval = cycle_count & 0xffff;
+    cycle_count_lock = false;
+    return retval;
+  }
+  static uint32_t GetTime32() {
+    cycle_count_lock = true;
+    uint32_t retval = cycle_count;
+    cycle_count_lock = false;
+    return retval;
+  }
+};
+
+struct Servo {
+  void Init() {}
+  void Off() {
+    NotifyHost();
+    servo_on = false;
+  }
+  void Set(uint16_t v) {
+    NotifyHost();
+    servo_on = true;
+    servo_state = v;
+  }
+};
+
+template <volatile bool* value>
+struct Gpio {
+  void ConfigureOutput() {}
+  void Set(bool v) {
+    NotifyHost();
+    *value = v;
+  }
+};
+
+template<typename Stepper>
+struct DebugStepper {
+  DebugStepper(volatile int32_t* steps, Stepper stepper)
+      : steps_(steps), stepper_(std::move(stepper)) {}
+
+  void Init() {
+    stepper_.Init();
+  }
+
+  void Off() {
+    stepper_.Off();
+  }
+
+  void Move(int8_t step) {
+    stepper_.Move(step);
+    *steps_ = *steps_ + step;
+  }
+
+  void SetFullStep(bool full_step) {
+    stepper_.SetFullStep(full_step);
+  }
+
+  volatile int32_t* steps_;
+  Stepper stepper_;
+};
+
+Driver driver{
+    Timer(),
+    DebugStepper(&left_steps,
+                 Stepper(List(Gpio<&left_coils[0]>(), Gpio<&left_coils[1]>(),
+                              Gpio<&left_coils[2]>(), Gpio<&left_coils[3]>()))),
+    DebugStepper(
+        &right_steps,
+        Stepper(List(Gpio<&right_coils[0]>(), Gpio<&right_coils[1]>(),
+                     Gpio<&right_coils[2]>(), Gpio<&right_coils[3]>()))),
+    Servo(),
+    &kCalibrationData};
+
+#endif  // AVR_BOARD_H_
@@ -0,0 +1,286 @@
+#ifndef AVR_TEST_H_
+#define AVR_TEST_H_
+
+#include <gtest/gtest.h>
+
+#include <simavr/avr_eeprom.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_io.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cxxabi.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace testing {
+
+// Runs the firmware build/<testname>.elf in simavr. The firmware sets `state`
+// to a non-zero value to return from Run().
+//
+// Instances are independent, so several can run in parallel threads.
+class AvrSim {
+ public:
+  static constexpr uint32_t ELF_DATA_OFFSET = 0x800000;
+  static constexpr uint32_t ELF_EEPROM_OFFSET = 0x810000;
+  // GPIOR0, written by the firmware when its outputs change (avr_board.h).
+  static constexpr avr_io_addr_t kEventRegister = 0x3e;
+
+  AvrSim(const std::string& testname)
+      : fw_filename_(std::string("build/") + testname + std::string(".elf")) {}
+  virtual ~AvrSim() {
+    if (avr_ != nullptr) avr_terminate(avr_);
+  }
+
+  void Load() {
+    elf_firmware_t fw_;
+    elf_read_firmware(fw_filename_.c_str(), &fw_);
+    for (unsigned int i = 0; i < fw_.symbolcount; ++i) {
+      avr_symbol_t* sym = fw_.symbol[i];
+      symbols_[sym->symbol] = sym->addr;
+      symbol_sizes_[sym->symbol] = sym->size;
+      // printf("0x%08x: %s\n", sym->addr, sym->symbol);
+    }
+    EXPECT_EQ(std::string(fw_.mmcu), "atmega328");
+    avr_ = avr_make_mcu_by_name(fw_.mmcu);
+    avr_init(avr_);
+    avr_load_firmware(avr_, &fw_);
+    avr_state_ = GetVar<uint8_t>("state");
+    avr_cycle_count_ = GetVar<uint32_t>("cycle_count");
+    avr_cycle_count_lock_ = GetVar<bool>("cycle_count_lock");
+  }
+
+  template <typename T, int num = 1>
+  T* GetVar(const std::string& var) {
+    T* ptr = [&]() -> T* {
+      auto it = symbols_.find(var);
+      if (it == symbols_.end()) return nullptr;
+      uint32_t addr = it->second;
+      if (addr < ELF_DATA_OFFSET) return nullptr;
+      addr -= ELF_DATA_OFFSET;
+      if (addr + num * sizeof(T) >= avr_->ramend) return nullptr;
+      return reinterpret_cast<T*>(&avr_->data[addr]);
+    }();
+    EXPECT_TRUE(ptr != nullptr);
+    return ptr;
+  }
+
+  // Overwrites EEPROM variable `var` with `bytes` in the layout of the
+  // firmware, which must match the size of the variable. The firmware sees the
+  // value if it reads the variable later, e.g. in static constructors when
+  // called before Run().
+  void SetEepromVar(const std::string& var, std::vector<uint8_t> bytes) {
+    auto it = symbols_.find(var);
+    ASSERT_TRUE(it != symbols_.end() && it->second >= ELF_EEPROM_OFFSET);
+    ASSERT_EQ(bytes.size(), symbol_sizes_[var]);
+    avr_eeprom_desc_t desc;
+    desc.ee = bytes.data();
+    desc.offset = it->second - ELF_EEPROM_OFFSET;
+    desc.size = bytes.size();
+    EXPECT_EQ(avr_ioctl(avr_, AVR_IOCTL_EEPROM_SET, &desc), 0);
+  }
+
+  // Contents of EEPROM variable `var`, in the layout of the firmware.
+  std::vector<uint8_t> GetEepromVar(const std::string& var) {
+    auto it = symbols_.find(var);
+    EXPECT_TRUE(it != symbols_.end() && it->second >= ELF_EEPROM_OFFSET);
+    if (it == symbols_.end() || it->second < ELF_EEPROM_OFFSET) return {};
+    std::vector<uint8_t> bytes(symbol_sizes_[var]);
+    avr_eeprom_desc_t desc;
+    desc.ee = bytes.data();
+    desc.offset = it->second - ELF_EEPROM_OFFSET;
+    desc.size = bytes.size();
+    EXPECT_EQ(avr_ioctl(avr_, AVR_IOCTL_EEPROM_GET, &desc), 0);
+    return bytes;
+  }
+
+  // By default StepDone() is called after each instruction. In event mode, it
+  // is called only when the firmware signals that its outputs are about to
+  // change, and at least each `max_step_cycles` cycles.
+  void SetEventMode(uint32_t max_step_cycles) {
+    max_step_cycles_ = max_step_cycles;
+    avr_register_io_write(avr_, kEventRegister, &EventWrite, this);
+  }
+
+  // Whether the tests should profile the firmware: AVR_PROFILE=1 in the
+  // environment. Profiling looks up the function of each instruction, so the
+  // default loop runs without it.
+  static bool ProfileRequested() {
+    const char* profile = getenv("AVR_PROFILE");
+    return profile != nullptr && strcmp(profile, "1") == 0;
+  }
+
+  // Attributes the cycles of each instruction executed by Run() to the
+  // function containing it, see PrintProfile(). Call after Load().
+  void EnableProfile() {
+    profile_names_ = {"(sleep)", "(unknown)"};
+    function_of_word_.assign((avr_->flashend + 1) / 2, kProfileUnknown);
+    // Sized symbols in flash. Of aliases, the first one by name is used.
+    for (const auto& [name, addr] : symbols_) {
+      uint32_t size = symbol_sizes_[name];
+      if (addr >= ELF_DATA_OFFSET || size == 0) continue;
+      if (addr / 2 >= function_of_word_.size() ||
+          function_of_word_[addr / 2] != kProfileUnknown) {
+        continue;
+      }
+      uint32_t end = std::min(addr + size, avr_->flashend + 1);
+      uint16_t index = profile_names_.size();
+      profile_names_.push_back(Demangle(name));
+      for (uint32_t a = addr; a < end; a += 2) function_of_word_[a / 2] = index;
+    }
+    profile_cycles_.assign(profile_names_.size(), 0);
+  }
+
+  // Prints the functions that took the most cycles, and a summary of the
+  // cycles in the runtime library (__*), interrupts (__vector_*) and sleep.
+  void PrintProfile(size_t top = 25) const {
+    uint64_t total = 0;
+    std::vector<std::pair<uint64_t, size_t>> sorted;
+    for (size_t i = 0; i < profile_cycles_.size(); ++i) {
+      total += profile_cycles_[i];
+      if (profile_cycles_[i] > 0) sorted.push_back({profile_cycles_[i], i});
+    }
+    if (total == 0) return;
+    std::sort(sorted.rbegin(), sorted.rend());
+    printf("Flat profile of %lu cycles:\n%12s %6s %6s  %s\n", total, "cycles",
+           "%", "cum%", "function");
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < std::min(top, sorted.size()); ++i) {
+      auto [cycles, index] = sorted[i];
+      cumulative += cycles;
+      printf("%12lu %6.2lf %6.2lf  %.100s\n", cycles, 100.0 * cycles / total,
+             100.0 * cumulative / total, profile_names_[index].c_str());
+    }
+
+    uint64_t runtime = 0;
+    uint64_t interrupts = 0;
+    for (size_t i = 0; i < profile_cycles_.size(); ++i) {
+      const std::string& name = profile_names_[i];
+      if (name.starts_with("__vector_")) {
+        interrupts += profile_cycles_[i];
+      } else if (name.starts_with("__")) {
+        runtime += profile_cycles_[i];
+      }
+    }
+    uint64_t sleep = profile_cycles_[kProfileSleep];
+    printf("Summary: firmware %.2lf%%, runtime library %.2lf%%, interrupts "
+           "%.2lf%%, sleep %.2lf%%\n",
+           100.0 * (total - runtime - interrupts - sleep) / total,
+           100.0 * runtime / total, 100.0 * interrupts / total,
+           100.0 * sleep / total);
+  }
+
+  int Run() {
+    auto wall_start = std::chrono::steady_clock::now();
+    avr_cycle_count_t cycle_start = avr_->cycle;
+    int state = cpu_Running;
+    *avr_state_ = 0;
+    last_step_ = avr_->cycle;
+    while (state != cpu_Done && state != cpu_Crashed && *avr_state_ == 0) {
+      if (!*avr_cycle_count_lock_) {
+        // Do not update in the middle of a read.
+        *avr_cycle_count_ = avr_->cycle;
+      }
+      if (profile_cycles_.empty()) {
+        state = avr_run(avr_);
+      } else {
+        uint32_t pc = avr_->pc;
+        bool sleeping = avr_->state == cpu_Sleeping;
+        avr_cycle_count_t cycle = avr_->cycle;
+        state = avr_run(avr_);
+        uint16_t index = kProfileUnknown;
+        if (sleeping) {
+          index = kProfileSleep;
+        } else if (pc / 2 < function_of_word_.size()) {
+          index = function_of_word_[pc / 2];
+        }
+        profile_cycles_[index] += avr_->cycle - cycle;
+      }
+      if (max_step_cycles_ == 0 || event_ ||
+          avr_->cycle - last_step_ >= max_step_cycles_) {
+        event_ = false;
+        last_step_ = avr_->cycle;
+        StepDone();
+      }
+    }
+    std::chrono::duration<double> wall =
+        std::chrono::steady_clock::now() - wall_start;
+    double simulated = (avr_->cycle - cycle_start) / static_cast<double>(F_CPU);
+    if (verbose_) {
+      printf("Simulated %.3lfs in %.3lfs of wall time (%.2lfx, %s mode)\n",
+             simulated, wall.count(), simulated / wall.count(),
+             max_step_cycles_ == 0 ? "step" : "event");
+    }
+    return state;
+  }
+
+  virtual void StepDone() {}
+
+  // Print progress to stdout.
+  bool verbose_ = true;
+
+  const std::string fw_filename_;
+  std::map<std::string, uint32_t> symbols_;
+  std::map<std::string, uint32_t> symbol_sizes_;
+  avr_t* avr_ = nullptr;
+
+  uint8_t* avr_state_;
+  uint32_t* avr_cycle_count_;
+  bool* avr_cycle_count_lock_;
+
+ private:
+  static constexpr uint16_t kProfileSleep = 0;
+  static constexpr uint16_t kProfileUnknown = 1;
+
+  static std::string Demangle(const std::string& name) {
+    int status;
+    char* demangled =
+        abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+    if (demangled == nullptr) return name;
+    std::string result = demangled;
+    free(demangled);
+    return result;
+  }
+
+  static void EventWrite(avr_t* avr, avr_io_addr_t addr, uint8_t v,
+                         void* param) {
+    avr->data[addr] = v;
+    static_cast<AvrSim*>(param)->event_ = true;
+  }
+
+  uint32_t max_step_cycles_ = 0;  // 0 outside of event mode
+  avr_cycle_count_t last_step_ = 0;
+  bool event_ = false;
+
+  // Function indices of flash words, names and cycles of the functions.
+  std::vector<uint16_t> function_of_word_;
+  std::vector<std::string> profile_names_;
+  std::vector<uint64_t> profile_cycles_;
+};
+
+class AvrTest : public Test, public AvrSim {
+ protected:
+  AvrTest(const std::string& testname) : AvrSim(testname) {}
+
+  using AvrSim::Run;
+
+  void SetUp() override {
+    Load();
+    if (ProfileRequested()) EnableProfile();
+  }
+
+  void TearDown() override {
+    PrintProfile();  // nothing without a profile
+  }
+};
+
+}  // namespace testing
+
+#endif  // AVR_TEST_H_
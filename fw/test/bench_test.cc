@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "avr_test.h"
+#include "host_board.h"
+
+namespace testing {
+
+// Measures the motion loop of Driver::Move on one move: how often it iterates
+// (each iteration reads the timer once), the longest iteration, and how late
+// the steps come compared to the ideal trapezoidal profile. Up to an iteration
+// late, except for the last few steps: Move decides to brake once per
+// iteration and reaches them a few ms early, so the check uses the 90th
+// percentile.
+//
+// The results are compared with kBaselineFile, which is kept in git. The test
+// fails if it is missing; run it with BENCH_UPDATE_BASELINE=1 to write the
+// results there as the new baseline.
+class BenchTest : public AvrTest {
+ protected:
+  static constexpr const char* kBaselineFile = "bench_baseline.txt";
+  static constexpr const char* kUpdateVar = "BENCH_UPDATE_BASELINE";
+  // Allowed regression against the baseline.
+  static constexpr double kTolerance = 0.1;
+
+  BenchTest() : AvrTest("bench_test") {}
+
+  // Called after each instruction.
+  void StepDone() override {
+    if (!measuring_) return;
+    bool lock = *avr_cycle_count_lock_;
+    if (lock && !lock_) reads_.push_back(avr_->cycle);
+    lock_ = lock;
+    // Also if one iteration makes more steps.
+    for (; last_steps_ != *left_steps_;
+         last_steps_ += *left_steps_ > last_steps_ ? 1 : -1) {
+      steps_.push_back(avr_->cycle);
+    }
+  }
+
+  // Seconds from the start of the move to step `k` (1-based) of a trapezoidal
+  // profile (max_j == 0). A step is made half way to the next position, as in Move.
+  static double IdealStepTime(int k, int d, const MotionLimits& limits) {
+    double v = limits.max_v;
+    double a = limits.max_a;
+    double x_a = std::min(v * v / (2 * a), d / 2.0);  // accelerating
+    v = sqrt(2 * a * x_a);  // top speed
+    double t_a = v / a;
+    double total = 2 * t_a + (d - 2 * x_a) / v;
+    double x = k - 0.5;
+    if (x <= x_a) return sqrt(2 * x / a);
+    if (x <= d - x_a) return t_a + (x - x_a) / v;
+    return total - sqrt(2 * (d - x) / a);
+  }
+
+  static std::map<std::string, double> ReadBaseline() {
+    std::map<std::string, double> baseline;
+    FILE* f = fopen(kBaselineFile, "r");
+    if (f == nullptr) return baseline;
+    char name[64];
+    double value;
+    while (fscanf(f, "%63s %lf", name, &value) == 2) baseline[name] = value;
+    fclose(f);
+    return baseline;
+  }
+
+  static void WriteBaseline(const std::map<std::string, double>& results) {
+    FILE* f = fopen(kBaselineFile, "w");
+    ASSERT_TRUE(f != nullptr);
+    for (const auto& [name, value] : results) {
+      fprintf(f, "%s %.3lf\n", name.c_str(), value);
+    }
+    fclose(f);
+  }
+
+  bool measuring_ = false;
+  bool lock_ = false;
+  int32_t* left_steps_;
+  int32_t last_steps_ = 0;
+  std::vector<avr_cycle_count_t> reads_;  // cycles of timer reads
+  std::vector<avr_cycle_count_t> steps_;  // cycles of steps of the left motor
+};
+
+TEST_F(BenchTest, Move) {
+  EXPECT_EQ(Run(), cpu_Running);
+  ASSERT_EQ(*avr_state_, 1);
+  left_steps_ = GetVar<int32_t>("left_steps");
+  last_steps_ = *left_steps_;
+  int d = *GetVar<int16_t>("bench_steps");
+  measuring_ = true;
+  EXPECT_EQ(Run(), cpu_Running);
+  EXPECT_EQ(*avr_state_, 2);
+  ASSERT_GE(reads_.size(), 2u);
+  ASSERT_EQ(steps_.size(), static_cast<size_t>(d));
+
+  // The move starts with the first timer read.
+  avr_cycle_count_t start = reads_[0];
+  double duration = (reads_.back() - start) / static_cast<double>(F_CPU);
+  double iterations = (reads_.size() - 1) / duration;
+  avr_cycle_count_t longest = 0;
+  for (size_t i = 1; i < reads_.size(); ++i) {
+    longest = std::max(longest, reads_[i] - reads_[i - 1]);
+  }
+  double max_latency = longest * 1e6 / F_CPU;
+
+  // The limits of the firmware, HostCalibration() is a copy of them.
+  CalibrationData calibration = HostCalibration();
+  ASSERT_EQ(GetEepromVar("kCalibrationData"),
+            AvrCalibrationBytes(calibration));
+  const MotionLimits& limits = calibration.limits[kRotateMove];
+  ASSERT_EQ(limits.max_j, 0u);
+  std::vector<double> errors;  // us
+  for (int k = 1; k <= d; ++k) {
+    double actual = (steps_[k - 1] - start) / static_cast<double>(F_CPU);
+    errors.push_back((actual - IdealStepTime(k, d, limits)) * 1e6);
+  }
+  double mean = 0.0;
+  for (double e : errors) mean += e;
+  mean /= errors.size();
+  double variance = 0.0;
+  for (double e : errors) variance += (e - mean) * (e - mean);
+  double stddev = sqrt(variance / errors.size());
+  std::vector<double> abs_errors;
+  for (double e : errors) abs_errors.push_back(fabs(e));
+  std::sort(abs_errors.begin(), abs_errors.end());
+  auto percentile = [&](double p) {
+    return abs_errors[static_cast<size_t>(p * (abs_errors.size() - 1))];
+  };
+
+  printf("Move: %d steps in %.3lfs, %.0lf iterations/s, longest iteration "
+         "%.1lfus\n",
+         d, duration, iterations, max_latency);
+  printf("Step timing error [us]: mean %.1lf, stddev %.1lf, |error| p50 %.1lf, "
+         "p90 %.1lf, p99 %.1lf, max %.1lf\n",
+         mean, stddev, percentile(0.5), percentile(0.9), percentile(0.99),
+         abs_errors.back());
+
+  std::map<std::string, double> results = {
+    {"iterations_per_second", iterations},
+    {"max_latency_us", max_latency},
+    {"step_error_p90_us", percentile(0.9)},
+  };
+  const char* update = getenv(kUpdateVar);
+  if (update != nullptr && strcmp(update, "1") == 0) {
+    printf("Saving results to %s\n", kBaselineFile);
+    WriteBaseline(results);
+    return;
+  }
+  std::map<std::string, double> baseline = ReadBaseline();
+  if (baseline.empty()) {
+    GTEST_SKIP() << "No baseline in " << kBaselineFile << ", run with "
+                 << kUpdateVar << "=1 to create it";
+  }
+  EXPECT_GE(iterations,
+            baseline["iterations_per_second"] * (1.0 - kTolerance));
+  EXPECT_LE(max_latency, baseline["max_latency_us"] * (1.0 + kTolerance));
+  // Errors are a fraction of an iteration, allow one more iteration.
+  EXPECT_LE(percentile(0.9), baseline["step_error_p90_us"] * (1.0 + kTolerance) +
+                                 1e6 / baseline["iterations_per_second"]);
+}
+
+}  // namespace testing
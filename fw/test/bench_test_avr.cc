@@ -0,0 +1,13 @@
+#include "avr_board.h"
+
+// Input: Steps of the benchmarked move, read by the host (bench_test.cc).
+volatile int16_t bench_steps USED = 2000;
+
+int main() {
+  state = 1;
+  auto intr = []() { return false; };
+  // A plain move, without pen changes and coil settling.
+  driver.RotateSteps(intr, bench_steps);
+  state = 2;
+  return 0;
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include <vector>
+
+#include "../checkpoint.h"
+
+namespace testing {
+
+// The eeprom shim of host/ is plain memory, so the slots are an array.
+class CheckpointTest : public Test {
+ protected:
+  static constexpr uint8_t kSlots = 4;
+
+  CheckpointTest() {
+    memset(slots_, 0xff, sizeof(slots_));  // erased eeprom
+  }
+
+  static DrawProgress Progress(uint32_t point) {
+    return DrawProgress{point, static_cast<uint8_t>(point % 2),
+                        static_cast<int16_t>(-7 * point),
+                        static_cast<uint16_t>(3 * point),
+                        static_cast<uint16_t>(5 * point)};
+  }
+
+  static void ExpectCheckpoint(const Checkpoint& c, uint8_t image,
+                               uint8_t variant, uint32_t point) {
+    EXPECT_EQ(c.image, image);
+    EXPECT_EQ(c.variant, variant);
+    DrawProgress p = Progress(point);
+    EXPECT_EQ(c.progress.point, p.point);
+    EXPECT_EQ(c.progress.pen, p.pen);
+    EXPECT_EQ(c.progress.angle_fraction, p.angle_fraction);
+    EXPECT_EQ(c.progress.left_remainder, p.left_remainder);
+    EXPECT_EQ(c.progress.right_remainder, p.right_remainder);
+  }
+
+  // Index of the slot changed by `f`, -1 if none.
+  template <typename F>
+  int WrittenSlot(F f) {
+    Checkpoint before[kSlots];
+    memcpy(before, slots_, sizeof(slots_));
+    f();
+    int written = -1;
+    for (int i = 0; i < kSlots; ++i) {
+      if (memcmp(&before[i], &slots_[i], sizeof(Checkpoint)) != 0) {
+        EXPECT_EQ(written, -1) << "more than one slot written";
+        written = i;
+      }
+    }
+    return written;
+  }
+
+  Checkpoint slots_[kSlots];
+};
+
+TEST_F(CheckpointTest, EmptyEeprom) {
+  Checkpoint c;
+  EXPECT_FALSE(CheckpointStore<kSlots>(slots_).Load(&c));
+  EXPECT_EQ(c.image, 0);
+
+  memset(slots_, 0, sizeof(slots_));
+  EXPECT_FALSE(CheckpointStore<kSlots>(slots_).Load(&c));
+  EXPECT_EQ(c.image, 0);
+}
+
+TEST_F(CheckpointTest, SaveLoadClear) {
+  CheckpointStore<kSlots> store(slots_);
+  Checkpoint c;
+  store.Load(&c);
+  store.Save(3, 2, Progress(1234));
+
+  // As after a reset.
+  CheckpointStore<kSlots> loaded(slots_);
+  EXPECT_TRUE(loaded.Load(&c));
+  ExpectCheckpoint(c, 3, 2, 1234);
+
+  loaded.Clear();
+  EXPECT_FALSE(CheckpointStore<kSlots>(slots_).Load(&c));
+}
+
+// Each save goes to the next slot, also after a reset, and the sequence
+// numbers keep their order when they wrap around.
+TEST_F(CheckpointTest, RoundRobin) {
+  int expected = 0;
+  for (uint32_t i = 0; i < 300; ++i) {
+    CheckpointStore<kSlots> store(slots_);
+    Checkpoint c;
+    bool found = store.Load(&c);
+    EXPECT_EQ(found, i != 0);
+    if (found) ExpectCheckpoint(c, 1, 1, i - 1);
+    EXPECT_EQ(WrittenSlot([&] { store.Save(1, 1, Progress(i)); }), expected)
+        << i;
+    expected = (expected + 1) % kSlots;
+  }
+}
+
+// A slot torn by a reset during the write is skipped.
+TEST_F(CheckpointTest, RejectsBadChecksum) {
+  CheckpointStore<kSlots> store(slots_);
+  Checkpoint c;
+  store.Load(&c);
+  store.Save(2, 1, Progress(10));
+  int torn = WrittenSlot([&] { store.Save(2, 1, Progress(20)); });
+  ASSERT_GE(torn, 0);
+  reinterpret_cast<uint8_t*>(&slots_[torn])[offsetof(Checkpoint, progress)] ^=
+      0x40;
+
+  CheckpointStore<kSlots> loaded(slots_);
+  EXPECT_TRUE(loaded.Load(&c));
+  ExpectCheckpoint(c, 2, 1, 10);
+  // The next save replaces the torn slot.
+  EXPECT_EQ(WrittenSlot([&] { loaded.Save(2, 1, Progress(30)); }), torn);
+  EXPECT_TRUE(CheckpointStore<kSlots>(slots_).Load(&c));
+  ExpectCheckpoint(c, 2, 1, 30);
+}
+
+}  // namespace testing
@@ -0,0 +1,477 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <vector>
+
+#include "host_board.h"
+#include "../../gendata/example-a4.h"
+#include "../../gendata/motif.h"
+
+namespace testing {
+
+// Runs images through the firmware Driver on the host and compares the motor
+// steps and pen changes with the moves of the image.
+class DrawHostTest : public Test {
+ protected:
+  void SetUp() override {
+    calibration_ = HostCalibration();
+    NewDriver();
+  }
+
+  // Starts over with a driver reading calibration_.
+  void NewDriver() {
+    left_ = {};
+    right_ = {};
+    servo_.clear();
+    driver_ = std::make_unique<HostDriver>(
+        VirtualTimer(), RecordingStepper{&left_}, RecordingStepper{&right_},
+        RecordingServo{&servo_}, &calibration_);
+  }
+
+  // Draws `entries` (moves and opcodes) and checks the result. Returns the
+  // robot time taken, in cycles.
+  uint32_t Draw(const std::vector<DataPoint>& entries) {
+    Image image{static_cast<uint16_t>(entries.size()), entries.data()};
+    uint32_t cycles_start = VirtualTimer::now;
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(driver_->DrawImage([]() { return false; }, &image));
+    std::chrono::duration<double> wall =
+        std::chrono::steady_clock::now() - start;
+    uint64_t steps = left_.steps + right_.steps;
+    printf("%lu steps in %.3lfs (%.2lf M steps/s), %.1lfs of robot time\n",
+           steps, wall.count(), steps / wall.count() / 1e6,
+           (VirtualTimer::now - cycles_start) / static_cast<double>(F_CPU));
+
+    std::vector<Move> moves;
+    for (const DataPoint& p : entries) {
+      moves.push_back({p.len, static_cast<int16_t>(p.angle), p.pen != 0});
+    }
+    int64_t left = 0;
+    int64_t right = 0;
+    uint64_t total = 0;
+    std::vector<uint16_t> servo;
+    auto pen = [&](bool down) {
+      uint16_t v = down ? calibration_.pen_down : calibration_.pen_up;
+      if (servo.empty() || servo.back() != v) servo.push_back(v);
+    };
+    for (const Move& m : ExpandMotifs(moves)) {
+      pen(m.pen);
+      // Rotation turns both wheels backwards, a forward move turns the left
+      // one backwards and the right one forwards.
+      left += -m.angle - m.len;
+      right += -m.angle + m.len;
+      total += 2 * (abs(m.angle) + abs(m.len));
+    }
+    pen(false);
+
+    EXPECT_EQ(left_.position, left);
+    EXPECT_EQ(right_.position, right);
+    EXPECT_EQ(steps, total);
+    EXPECT_EQ(servo_, servo);
+    EXPECT_FALSE(left_.on);
+    EXPECT_FALSE(right_.on);
+    return VirtualTimer::now - cycles_start;
+  }
+
+  CalibrationData calibration_;
+  StepperRecord left_;
+  StepperRecord right_;
+  std::vector<uint16_t> servo_;
+  std::unique_ptr<HostDriver> driver_;
+};
+
+TEST_F(DrawHostTest, Example) {
+  Image image = ReadImageData(&kExample);
+  Draw(std::vector<DataPoint>(image.points, image.points + image.num_points));
+}
+
+// A pattern repeated with calls, as gendata emits it.
+TEST_F(DrawHostTest, Motifs) {
+  std::vector<Move> moves;
+  for (int i = 0; i < 50; ++i) {
+    moves.push_back({200, 0, true});
+    moves.push_back({100, 1565, true});
+    moves.push_back({300, -1565, i % 2 == 0});
+    moves.push_back({-20, 7, false});
+  }
+  std::vector<DataPoint> entries;
+  for (const Move& m : CompressMotifs(moves)) {
+    DataPoint p;
+    p.len = m.len;
+    p.angle = m.angle;
+    p.pen = m.pen;
+    entries.push_back(p);
+  }
+  EXPECT_LT(entries.size(), moves.size());
+  Draw(entries);
+}
+
+// Calls longer than the DataPoint fields can hold are split.
+TEST_F(DrawHostTest, LongMotif) {
+  std::vector<Move> motif;
+  // Does not repeat within 16384 moves.
+  for (int i = 0; i < 17000; ++i) {
+    motif.push_back({static_cast<int16_t>(1 + i % 101),
+                     static_cast<int16_t>(i % 167 - 83), true});
+  }
+  std::vector<Move> moves = motif;
+  moves.insert(moves.end(), motif.begin(), motif.end());
+  std::vector<DataPoint> entries;
+  std::vector<Move> stored;  // as read back from `entries`
+  for (const Move& m : CompressMotifs(moves)) {
+    DataPoint p;
+    p.len = m.len;
+    p.angle = m.angle;
+    p.pen = m.pen;
+    entries.push_back(p);
+    stored.push_back({p.len, static_cast<int16_t>(p.angle), p.pen != 0});
+  }
+  EXPECT_LT(entries.size(), moves.size());
+  EXPECT_TRUE(ExpandMotifs(stored) == moves);
+  Draw(entries);
+}
+
+// With a jerk limit, every move still ends exactly at its length: the step
+// totals match the image only if no move overshoots and steps back.
+TEST_F(DrawHostTest, SCurve) {
+  Image image = ReadImageData(&kExample);
+  std::vector<DataPoint> entries(image.points,
+                                 image.points + image.num_points);
+  // Short moves, down to a single step, which end before the acceleration
+  // ramps up.
+  for (int16_t len = 1; len < 60; len += 3) {
+    DataPoint p;
+    p.len = len % 2 ? len : -len;
+    p.angle = len % 7 - 3;
+    p.pen = len % 3 != 0;
+    entries.push_back(p);
+  }
+
+  for (uint32_t read_cycles : {256u, 1024u}) {
+    VirtualTimer::read_cycles = read_cycles;
+    calibration_ = HostCalibration();
+    NewDriver();
+    uint32_t trapezoid = Draw(entries);
+    // Acceleration ramps of 1/10s and 1/200s.
+    for (uint32_t max_j : {75000u, 1500000u}) {
+      for (MotionLimits& l : calibration_.limits) l.max_j = max_j;
+      NewDriver();
+      uint32_t s_curve = Draw(entries);
+      EXPECT_GT(s_curve, trapezoid) << read_cycles << " " << max_j;
+    }
+  }
+  VirtualTimer::read_cycles = 256;
+}
+
+// Stream whose host sends each point only after the robot polled for it a
+// while.
+struct SlowStream {
+  static constexpr int kPolls = 100;
+
+  void Poll() {}
+
+  bool Pop(DataPoint* p) {
+    if (next == points.size()) return false;
+    if (++polls < kPolls) {
+      // From the second poll on, the robot knows it waits.
+      if (polls > 1 && (left->on || right->on)) on_while_waiting = true;
+      return false;
+    }
+    polls = 0;
+    *p = points[next++];
+    return true;
+  }
+
+  bool Done() const {
+    return next == points.size();
+  }
+
+  std::vector<DataPoint> points;
+  const StepperRecord* left;
+  const StepperRecord* right;
+  size_t next = 0;
+  int polls = 0;
+  bool on_while_waiting = false;
+};
+
+// Waiting for the host releases the coils, if they may be released.
+TEST_F(DrawHostTest, StreamWaitReleasesCoils) {
+  std::vector<DataPoint> points;
+  for (int i = 0; i < 10; ++i) {
+    DataPoint p;
+    p.len = 50 + i;
+    p.angle = i % 2 ? 300 : -300;
+    p.pen = 1;
+    points.push_back(p);
+  }
+  for (uint8_t settle_ms : {0, 5}) {
+    calibration_.coil_settle_ms = settle_ms;
+    NewDriver();
+    SlowStream stream{points, &left_, &right_};
+    EXPECT_TRUE(driver_->DrawStream([]() { return false; }, &stream));
+    EXPECT_EQ(stream.on_while_waiting, settle_ms == 0);
+    // The moves are complete either way.
+    int64_t left = 0;
+    int64_t right = 0;
+    for (const DataPoint& p : points) {
+      left += -p.angle - p.len;
+      right += -p.angle + p.len;
+    }
+    EXPECT_EQ(left_.position, left);
+    EXPECT_EQ(right_.position, right);
+  }
+}
+
+// Resuming from a checkpoint draws the rest of the image as the uninterrupted
+// drawing did from the start of that point, fractional remainders included.
+TEST_F(DrawHostTest, Resume) {
+  // Fractions that leave remainders between points.
+  calibration_.angle_offset = 37;
+  calibration_.left_fraction = (1 << 14) + 1000;
+  calibration_.right_fraction = (1 << 14) - 700;
+  std::vector<Move> moves;
+  for (int i = 0; i < 20; ++i) {
+    moves.push_back({200, 0, true});
+    moves.push_back({100, 1565, true});
+    moves.push_back({static_cast<int16_t>(30 + i), -700, i % 3 != 0});
+  }
+  std::vector<DataPoint> entries;
+  for (const Move& m : CompressMotifs(moves)) {
+    DataPoint p;
+    p.len = m.len;
+    p.angle = m.angle;
+    p.pen = m.pen;
+    entries.push_back(p);
+  }
+  Image image{static_cast<uint16_t>(entries.size()), entries.data()};
+
+  struct Run {
+    StepperRecord left;
+    StepperRecord right;
+    std::vector<uint16_t> servo;
+  };
+  // Draws the image from `progress` until `interrupted`. Returns whether it
+  // finished.
+  auto draw = [&](Run* run, DrawProgress* progress, auto interrupted,
+                  auto save_progress) {
+    HostDriver driver(VirtualTimer(), RecordingStepper{&run->left},
+                      RecordingStepper{&run->right},
+                      RecordingServo{&run->servo}, &calibration_);
+    Transformed source(ImageReader(&image), ImageTransform{});
+    return driver.DrawImage(interrupted, &source, progress, save_progress);
+  };
+  auto never = []() { return false; };
+
+  // Progress and positions at the start of each point.
+  Run full;
+  std::vector<DrawProgress> starts;
+  std::vector<std::pair<int64_t, int64_t>> positions;
+  DrawProgress progress = {};
+  uint32_t start_cycles = VirtualTimer::now;
+  EXPECT_TRUE(draw(&full, &progress, never,
+                   [&](const DrawProgress& p, bool force) {
+                     EXPECT_FALSE(force);
+                     EXPECT_EQ(p.point, starts.size());
+                     starts.push_back(p);
+                     positions.push_back(
+                         {full.left.position, full.right.position});
+                   }));
+  uint32_t duration = VirtualTimer::now - start_cycles;
+  ASSERT_EQ(starts.size(), moves.size());
+
+  // Interrupted halfway, after the robot moved within a point.
+  Run interrupted;
+  progress = {};
+  uint32_t stop = VirtualTimer::now + duration / 2;
+  int64_t point_start = 0;
+  bool saved = false;
+  DrawProgress checkpoint;
+  EXPECT_FALSE(draw(&interrupted, &progress,
+                    [&]() {
+                      return VirtualTimer::now >= stop &&
+                             interrupted.left.position != point_start;
+                    },
+                    [&](const DrawProgress& p, bool force) {
+                      if (!force) {
+                        point_start = interrupted.left.position;
+                        return;
+                      }
+                      saved = true;
+                      checkpoint = p;
+                    }));
+  ASSERT_TRUE(saved);
+  ASSERT_LT(checkpoint.point, starts.size());
+  // The checkpoint is the start of the interrupted point, not where the
+  // robot stopped.
+  const DrawProgress& expected = starts[checkpoint.point];
+  EXPECT_EQ(checkpoint.pen, expected.pen);
+  EXPECT_EQ(checkpoint.angle_fraction, expected.angle_fraction);
+  EXPECT_EQ(checkpoint.left_remainder, expected.left_remainder);
+  EXPECT_EQ(checkpoint.right_remainder, expected.right_remainder);
+  EXPECT_NE(interrupted.left.position, positions[checkpoint.point].first);
+
+  // From the interruption, and from an older periodic checkpoint.
+  for (const DrawProgress& from : {checkpoint, starts[checkpoint.point / 2]}) {
+    Run resumed;
+    progress = from;
+    EXPECT_TRUE(draw(&resumed, &progress, never,
+                     [](const DrawProgress&, bool) {}));
+    EXPECT_EQ(resumed.left.position,
+              full.left.position - positions[from.point].first)
+        << from.point;
+    EXPECT_EQ(resumed.right.position,
+              full.right.position - positions[from.point].second)
+        << from.point;
+    uint16_t pen = moves[from.point].pen ? calibration_.pen_down
+                                         : calibration_.pen_up;
+    ASSERT_FALSE(resumed.servo.empty());
+    EXPECT_EQ(resumed.servo.front(), pen);
+    EXPECT_EQ(resumed.servo.back(), calibration_.pen_up);
+  }
+}
+
+struct TestGpio {
+  void ConfigureOutput() {}
+  void Set(bool v) {
+    *value = v;
+  }
+
+  bool* value;
+};
+
+struct CoilRecord : StepperRecord {
+  bool coils[4] = {};
+  bool full_step = false;
+  uint64_t full_steps = 0;  // steps moved in full-step mode
+  int switches = 0;  // between the modes
+};
+
+using TestCoils = List<TestGpio, TestGpio, TestGpio, TestGpio>;
+
+// Stepper of the firmware on recorded coils. Each change is checked against
+// the position the driver moved it to: in half-step mode the coils drive the
+// position, in full-step mode the next odd half-step.
+class CoilStepper : public Stepper<TestCoils> {
+ public:
+  explicit CoilStepper(CoilRecord* record)
+      : Stepper(TestCoils(
+            TestGpio{&record->coils[0]}, TestGpio{&record->coils[1]},
+            TestGpio{&record->coils[2]}, TestGpio{&record->coils[3]})),
+        record_(record) {}
+
+  void Off() {
+    Stepper::Off();
+    record_->on = false;
+  }
+
+  void Move(int8_t step) {
+    Stepper::Move(step);
+    record_->on = true;
+    record_->position += step;
+    uint8_t abs_step = step < 0 ? -step : step;
+    record_->steps += abs_step;
+    if (record_->full_step) record_->full_steps += abs_step;
+    Check();
+  }
+
+  void SetFullStep(bool full_step) {
+    Stepper::SetFullStep(full_step);
+    if (full_step != record_->full_step) ++record_->switches;
+    record_->full_step = full_step;
+    if (record_->on) Check();
+  }
+
+ private:
+  void Check() {
+    uint8_t pos = ((record_->position % 8) + 8) % 8;
+    if (record_->full_step) pos |= 1;
+    // Even positions drive one coil, odd ones the two around them.
+    bool expected[4] = {};
+    expected[pos / 2] = true;
+    if (pos % 2) expected[(pos / 2 + 1) % 4] = true;
+    for (int i = 0; i < 4; ++i) {
+      ASSERT_EQ(record_->coils[i], expected[i])
+          << "coil " << i << " at " << record_->position
+          << (record_->full_step ? " full-step" : " half-step");
+    }
+  }
+
+  CoilRecord* record_;
+};
+
+// Pen-up travel switches to full-step drive at speed. Switching either way,
+// and stopping in full-step mode, keeps the phase of the coils.
+TEST(FullStepHostTest, KeepsPhase) {
+  CalibrationData calibration = HostCalibration();
+  CoilRecord left;
+  CoilRecord right;
+  std::vector<uint16_t> servo;
+  Driver<VirtualTimer, CoilStepper, CoilStepper, RecordingServo> driver(
+      VirtualTimer(), CoilStepper(&left), CoilStepper(&right),
+      RecordingServo{&servo}, &calibration);
+  driver.Init();
+
+  std::vector<DataPoint> entries;
+  for (const Move& m : std::vector<Move>{{2001, 0, false},
+                                         {301, 777, true},
+                                         {-1503, -1565, false},
+                                         {7, 3, false}}) {
+    DataPoint p;
+    p.len = m.len;
+    p.angle = m.angle;
+    p.pen = m.pen;
+    entries.push_back(p);
+  }
+  Image image{static_cast<uint16_t>(entries.size()), entries.data()};
+  auto draw = [&](auto interrupted, auto save_progress) {
+    Transformed source(ImageReader(&image), ImageTransform{});
+    DrawProgress progress = {};
+    return driver.DrawImage(interrupted, &source, &progress, save_progress);
+  };
+
+  // Stopped in the middle of the first travel, in full-step mode.
+  bool saved = false;
+  EXPECT_FALSE(draw(
+      [&]() { return left.full_step && left.full_steps > 101; },
+      [&](const DrawProgress&, bool force) {
+        if (!force) return;
+        saved = true;
+        // Back in half-step mode, the coils checked at the position reached.
+        EXPECT_FALSE(left.full_step);
+        EXPECT_FALSE(right.full_step);
+        EXPECT_TRUE(left.on);
+        EXPECT_EQ(left.position, -right.position);
+      }));
+  EXPECT_TRUE(saved);
+  EXPECT_FALSE(left.on);
+  int64_t left_start = left.position;
+  int64_t right_start = right.position;
+
+  // The whole image from there, the coils picking up the phase they had.
+  left.full_steps = 0;
+  right.full_steps = 0;
+  left.switches = 0;
+  uint64_t steps_start = left.steps + right.steps;
+  EXPECT_TRUE(draw([]() { return false; }, [](const DrawProgress&, bool) {}));
+  int64_t left_moved = 0;
+  int64_t right_moved = 0;
+  uint64_t travel = 0;
+  for (const DataPoint& p : entries) {
+    left_moved += -p.angle - p.len;
+    right_moved += -p.angle + p.len;
+    if (!p.pen) travel += 2 * abs(p.len);
+  }
+  EXPECT_EQ(left.position - left_start, left_moved);
+  EXPECT_EQ(right.position - right_start, right_moved);
+  EXPECT_FALSE(left.full_step);
+  EXPECT_FALSE(right.full_step);
+  // Only the fast part of the long travels is full-step.
+  uint64_t full_steps = left.full_steps + right.full_steps;
+  EXPECT_GT(full_steps, travel / 2);
+  EXPECT_LT(full_steps, travel);
+  EXPECT_LT(full_steps, left.steps + right.steps - steps_start);
+  EXPECT_EQ(left.switches, 4);
+}
+
+}  // namespace testing
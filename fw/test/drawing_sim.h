@@ -0,0 +1,79 @@
+#ifndef DRAWING_SIM_H_
+#define DRAWING_SIM_H_
+
+#include <string>
+
+#include "avr_test.h"
+#include "event_log.h"
+#include "robot_sim.h"
+
+namespace testing {
+
+// Simulates the robot driven by the firmware build/<testname>.elf. With
+// RecordEvents(), the outputs of the firmware are saved for ReplayEvents().
+class DrawingSim : public AvrSim, public RobotSim {
+ public:
+  DrawingSim(const std::string& testname)
+      : DrawingSim(testname, std::string("build/") + testname) {}
+
+  DrawingSim(const std::string& testname, const std::string& output)
+      : AvrSim(testname), RobotSim(output), output_(output) {}
+
+  void Load() {
+    AvrSim::Load();
+    SetEventMode(kMaxPhysicsStep);
+    print_state_ = verbose_;
+    Start(GetVar<bool, kNumCoils>("left_coils"), GetVar<int32_t>("left_steps"),
+          GetVar<bool, kNumCoils>("right_coils"),
+          GetVar<int32_t>("right_steps"), GetVar<bool>("servo_on"),
+          GetVar<uint16_t>("servo_state"), avr_->cycle);
+  }
+
+  // Call after Load().
+  bool RecordEvents(const std::string& filename) {
+    return log_.Open(filename, avr_->cycle);
+  }
+
+  void StepDone() override {
+    // The outputs read now were set just after the previous step.
+    if (log_.IsOpen()) log_.Write(last_cycle_, Outputs());
+    Update(avr_->cycle);
+  }
+
+  void Finish() {
+    if (log_.IsOpen()) log_.Close(last_cycle_);
+    RobotSim::Finish();
+  }
+
+  const std::string output_;
+
+ private:
+  OutputEvent Outputs() const {
+    return OutputEvent::FromState(left_->Coils(), right_->Coils(), *servo_on_,
+                                  *servo_state_);
+  }
+
+  EventLogWriter log_;
+};
+
+class DrawingTest : public Test, public DrawingSim {
+ protected:
+  DrawingTest(const std::string& testname) : DrawingSim(testname) {}
+
+  using DrawingSim::Run;
+
+  void SetUp() override {
+    Load();
+    if (ProfileRequested()) EnableProfile();
+    EXPECT_TRUE(RecordEvents(output_ + ".events"));
+  }
+
+  void TearDown() override {
+    PrintProfile();  // nothing without a profile
+    Finish();
+  }
+};
+
+}  // namespace testing
+
+#endif  // DRAWING_SIM_H_
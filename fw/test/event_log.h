@@ -0,0 +1,201 @@
+#ifndef EVENT_LOG_H_
+#define EVENT_LOG_H_
+
+// Compact binary log of the outputs of the simulated firmware: the coils of
+// both motors and the servo, recorded when they change.
+//
+// The file starts with kEventLogMagic, F_CPU and the first cycle (uint32, little
+// endian). Each record is
+// - a LEB128 varint: cycles since the previous record << 2 | flags,
+// - unless kEventEnd: the coils, left ones in the low nibble,
+// - if kEventServo: the servo value (uint16, little endian, 0 if off).
+// The last record has kEventEnd and marks the end of the simulation.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+namespace testing {
+
+constexpr char kEventLogMagic[4] = {'C', 'O', 'I', 'L'};
+constexpr uint8_t kEventServo = 1;
+constexpr uint8_t kEventEnd = 2;
+
+// Outputs of the firmware, set from the cycle of the event on.
+struct OutputEvent {
+  static constexpr int kNumCoils = 4;
+
+  uint8_t coils = 0;
+  uint16_t servo = 0;  // 0 if off
+
+  static OutputEvent FromState(const bool* left_coils, const bool* right_coils,
+                               bool servo_on, uint16_t servo_state) {
+    OutputEvent e;
+    for (int i = 0; i < kNumCoils; ++i) {
+      e.coils |= left_coils[i] << i;
+      e.coils |= right_coils[i] << (i + kNumCoils);
+    }
+    e.servo = servo_on ? servo_state : 0;
+    return e;
+  }
+
+  // The servo keeps its last value when off.
+  void ToState(bool* left_coils, bool* right_coils, bool* servo_on,
+               uint16_t* servo_state) const {
+    for (int i = 0; i < kNumCoils; ++i) {
+      left_coils[i] = coils & (1 << i);
+      right_coils[i] = coils & (1 << (i + kNumCoils));
+    }
+    *servo_on = servo != 0;
+    if (servo != 0) *servo_state = servo;
+  }
+
+  bool operator==(const OutputEvent&) const = default;
+};
+
+class EventLogWriter {
+ public:
+  ~EventLogWriter() {
+    if (f_ != nullptr) fclose(f_);
+  }
+
+  bool Open(const std::string& filename, uint32_t cycle) {
+    f_ = fopen(filename.c_str(), "wb");
+    if (f_ == nullptr) return false;
+    fwrite(kEventLogMagic, sizeof(kEventLogMagic), 1, f_);
+    WriteU32(F_CPU);
+    WriteU32(cycle);
+    cycle_ = cycle;
+    last_ = OutputEvent();
+    return true;
+  }
+
+  bool IsOpen() const {
+    return f_ != nullptr;
+  }
+
+  // Records `event` unless the outputs are the same as before.
+  void Write(uint32_t cycle, const OutputEvent& event) {
+    if (event == last_) return;
+    uint8_t flags = event.servo != last_.servo ? kEventServo : 0;
+    WriteVarint(static_cast<uint64_t>(cycle - cycle_) << 2 | flags);
+    fputc(event.coils, f_);
+    if (flags & kEventServo) WriteU16(event.servo);
+    cycle_ = cycle;
+    last_ = event;
+  }
+
+  // Ends the log at `cycle`, the end of the simulation.
+  void Close(uint32_t cycle) {
+    WriteVarint(static_cast<uint64_t>(cycle - cycle_) << 2 | kEventEnd);
+    fclose(f_);
+    f_ = nullptr;
+  }
+
+ private:
+  void WriteVarint(uint64_t v) {
+    while (v >= 0x80) {
+      fputc((v & 0x7f) | 0x80, f_);
+      v >>= 7;
+    }
+    fputc(v, f_);
+  }
+
+  void WriteU16(uint16_t v) {
+    fputc(v & 0xff, f_);
+    fputc(v >> 8, f_);
+  }
+
+  void WriteU32(uint32_t v) {
+    WriteU16(v & 0xffff);
+    WriteU16(v >> 16);
+  }
+
+  FILE* f_ = nullptr;
+  uint32_t cycle_;
+  OutputEvent last_;
+};
+
+class EventLogReader {
+ public:
+  ~EventLogReader() {
+    if (f_ != nullptr) fclose(f_);
+  }
+
+  // Fails also for logs of a firmware with a different F_CPU.
+  bool Open(const std::string& filename, uint32_t* cycle) {
+    f_ = fopen(filename.c_str(), "rb");
+    if (f_ == nullptr) return false;
+    char magic[sizeof(kEventLogMagic)];
+    uint32_t f_cpu;
+    if (fread(magic, sizeof(magic), 1, f_) != 1 ||
+        memcmp(magic, kEventLogMagic, sizeof(magic)) != 0 ||
+        !ReadU32(&f_cpu) || f_cpu != F_CPU || !ReadU32(&cycle_)) {
+      return false;
+    }
+    *cycle = cycle_;
+    return true;
+  }
+
+  // Reads the next record. The end record repeats the last outputs.
+  bool Next(uint32_t* cycle, OutputEvent* event) {
+    uint64_t v;
+    if (end_ || !ReadVarint(&v)) return false;
+    cycle_ += static_cast<uint32_t>(v >> 2);
+    if (v & kEventEnd) {
+      end_ = true;
+    } else {
+      int coils = fgetc(f_);
+      if (coils == EOF) return false;
+      last_.coils = coils;
+      if ((v & kEventServo) && !ReadU16(&last_.servo)) return false;
+    }
+    *cycle = cycle_;
+    *event = last_;
+    return true;
+  }
+
+  // Whether the end record was read, false for truncated logs.
+  bool AtEnd() const {
+    return end_;
+  }
+
+ private:
+  bool ReadVarint(uint64_t* v) {
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      int c = fgetc(f_);
+      if (c == EOF) return false;
+      *v |= static_cast<uint64_t>(c & 0x7f) << shift;
+      if ((c & 0x80) == 0) return true;
+    }
+    return false;
+  }
+
+  bool ReadU16(uint16_t* v) {
+    int lo = fgetc(f_);
+    int hi = fgetc(f_);
+    if (lo == EOF || hi == EOF) return false;
+    *v = lo | hi << 8;
+    return true;
+  }
+
+  bool ReadU32(uint32_t* v) {
+    uint16_t lo;
+    uint16_t hi;
+    if (!ReadU16(&lo) || !ReadU16(&hi)) return false;
+    *v = lo | static_cast<uint32_t>(hi) << 16;
+    return true;
+  }
+
+  FILE* f_ = nullptr;
+  uint32_t cycle_ = 0;
+  OutputEvent last_;
+  bool end_ = false;
+};
+
+}  // namespace testing
+
+#endif  // EVENT_LOG_H_
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "event_log.h"
+
+namespace testing {
+
+struct Record {
+  uint32_t cycle;
+  OutputEvent event;
+};
+
+OutputEvent Event(uint8_t coils, uint16_t servo) {
+  OutputEvent e;
+  e.coils = coils;
+  e.servo = servo;
+  return e;
+}
+
+class EventLogTest : public Test {
+ protected:
+  // Starts shortly before the cycle counter wraps around.
+  static constexpr uint32_t kStart = 0xfffffff0;
+
+  // Writes `records` and ends the log at `end`.
+  void Write(const std::vector<Record>& records, uint32_t end) {
+    EventLogWriter writer;
+    ASSERT_TRUE(writer.Open(filename_, kStart));
+    for (const Record& r : records) writer.Write(r.cycle, r.event);
+    writer.Close(end);
+  }
+
+  // Reads the records until Next() fails.
+  std::vector<Record> Read(EventLogReader* reader) {
+    uint32_t cycle = 0;
+    EXPECT_TRUE(reader->Open(filename_, &cycle));
+    EXPECT_EQ(cycle, kStart);
+    std::vector<Record> records;
+    Record r;
+    while (reader->Next(&r.cycle, &r.event)) records.push_back(r);
+    return records;
+  }
+
+  const std::string filename_ = "build/event_log_host_test.events";
+
+  // Outputs of the test, with the servo on from the second one on.
+  const std::vector<Record> records_ = {
+    {kStart + 3, Event(0x11, 0)},
+    {kStart + 0x20, Event(0x11, 1500)},  // after the wrap
+    {0x7ffffff0, Event(0x33, 1500)},  // 2^31 cycles later
+    {0x7ffffff0 + 0xffffffff, Event(0x32, 1000)},  // 2^32 - 1 cycles later
+    {0x90000000, Event(0x32, 0)},  // servo off
+    {0x90000001, Event(0xff, 0)},
+  };
+};
+
+TEST_F(EventLogTest, RoundTrip) {
+  Write(records_, 0x90000100);
+
+  EventLogReader reader;
+  std::vector<Record> read = Read(&reader);
+  ASSERT_EQ(read.size(), records_.size() + 1);
+  for (size_t i = 0; i < records_.size(); ++i) {
+    EXPECT_EQ(read[i].cycle, records_[i].cycle) << i;
+    EXPECT_TRUE(read[i].event == records_[i].event) << i;
+  }
+  // The end record repeats the last outputs.
+  EXPECT_EQ(read.back().cycle, 0x90000100u);
+  EXPECT_TRUE(read.back().event == records_.back().event);
+  EXPECT_TRUE(reader.AtEnd());
+}
+
+TEST_F(EventLogTest, SkipsUnchangedOutputs) {
+  Write({{10, Event(0x11, 0)}, {20, Event(0x11, 0)}, {30, Event(0x12, 0)}},
+        40);
+
+  EventLogReader reader;
+  std::vector<Record> read = Read(&reader);
+  ASSERT_EQ(read.size(), 3u);
+  EXPECT_EQ(read[0].cycle, 10u);
+  EXPECT_EQ(read[1].cycle, 30u);
+  EXPECT_TRUE(read[1].event == Event(0x12, 0));
+  EXPECT_TRUE(reader.AtEnd());
+}
+
+TEST_F(EventLogTest, ServoKeepsValueWhenOff) {
+  bool left[OutputEvent::kNumCoils];
+  bool right[OutputEvent::kNumCoils];
+  bool servo_on = false;
+  uint16_t servo_state = 0;
+  Event(0x21, 1500).ToState(left, right, &servo_on, &servo_state);
+  EXPECT_TRUE(servo_on);
+  EXPECT_EQ(servo_state, 1500);
+  EXPECT_TRUE(Event(0x21, 1500) ==
+              OutputEvent::FromState(left, right, servo_on, servo_state));
+
+  Event(0x21, 0).ToState(left, right, &servo_on, &servo_state);
+  EXPECT_FALSE(servo_on);
+  EXPECT_EQ(servo_state, 1500);
+  EXPECT_TRUE(Event(0x21, 0) ==
+              OutputEvent::FromState(left, right, servo_on, servo_state));
+}
+
+// A log cut anywhere after the header reads as a prefix of the records and is
+// not at its end.
+TEST_F(EventLogTest, Truncated) {
+  Write(records_, 0x90000100);
+  std::uintmax_t size = std::filesystem::file_size(filename_);
+  // Magic, F_CPU and the first cycle.
+  constexpr std::uintmax_t kHeaderSize = 12;
+
+  size_t last_read = 0;
+  for (std::uintmax_t s = size - 1; s >= kHeaderSize; --s) {
+    std::filesystem::resize_file(filename_, s);
+    EventLogReader reader;
+    std::vector<Record> read = Read(&reader);
+    EXPECT_FALSE(reader.AtEnd()) << s;
+    ASSERT_LE(read.size(), records_.size()) << s;
+    for (size_t i = 0; i < read.size(); ++i) {
+      EXPECT_EQ(read[i].cycle, records_[i].cycle) << s << " " << i;
+      EXPECT_TRUE(read[i].event == records_[i].event) << s << " " << i;
+    }
+    if (s == size - 1) last_read = read.size();
+  }
+  EXPECT_EQ(last_read, records_.size());
+}
+
+}  // namespace testing
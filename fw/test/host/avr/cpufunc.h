@@ -0,0 +1,6 @@
+#ifndef HOST_AVR_CPUFUNC_H_
+#define HOST_AVR_CPUFUNC_H_
+
+// Host build shim.
+
+#endif  // HOST_AVR_CPUFUNC_H_
@@ -0,0 +1,18 @@
+#ifndef HOST_AVR_EEPROM_H_
+#define HOST_AVR_EEPROM_H_
+
+// Host build shim: eeprom is plain memory.
+
+#include <string.h>
+
+#define EEMEM
+
+inline void eeprom_read_block(void* dst, const void* src, size_t n) {
+  memcpy(dst, src, n);
+}
+
+inline void eeprom_update_block(const void* src, void* dst, size_t n) {
+  memcpy(dst, src, n);
+}
+
+#endif  // HOST_AVR_EEPROM_H_
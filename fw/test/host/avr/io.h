@@ -0,0 +1,7 @@
+#ifndef HOST_AVR_IO_H_
+#define HOST_AVR_IO_H_
+
+// Host build shim: there are no registers. gpio.h uses its stub
+// implementation outside of __AVR__.
+
+#endif  // HOST_AVR_IO_H_
@@ -0,0 +1,14 @@
+#ifndef HOST_AVR_PGMSPACE_H_
+#define HOST_AVR_PGMSPACE_H_
+
+// Host build shim: program memory is plain memory.
+
+#include <string.h>
+
+#define PROGMEM
+
+inline void* memcpy_P(void* dst, const void* src, size_t n) {
+  return memcpy(dst, src, n);
+}
+
+#endif  // HOST_AVR_PGMSPACE_H_
@@ -0,0 +1,126 @@
+#ifndef HOST_BOARD_H_
+#define HOST_BOARD_H_
+
+// Robot for host builds of the firmware (host/ has the avr-libc shims). Time
+// is virtual and advances by modelled costs; the steppers and the servo record
+// what they are asked to do.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "../driver.h"
+
+// Virtual time in cpu cycles. Each read costs read_cycles, which models one
+// iteration of the busy loops of Driver.
+struct VirtualTimer {
+  static constexpr uint32_t kMaxIdle = 0x10000;
+
+  static void Init() {}
+
+  static uint16_t GetTime() {
+    return GetTime32();
+  }
+
+  static uint32_t GetTime32() {
+    now += read_cycles;
+    return now;
+  }
+
+  // Nothing interrupts the idle cpu, so waits are skipped.
+  static void Idle() {
+    now += kMaxIdle;
+  }
+
+  static inline uint32_t now = 0;
+  static inline uint32_t read_cycles = 256;  // 64us
+};
+
+struct StepperRecord {
+  int64_t position = 0;  // steps
+  uint64_t steps = 0;  // steps in either direction
+  bool on = false;
+};
+
+struct RecordingStepper {
+  void Init() {}
+
+  void Off() {
+    record->on = false;
+  }
+
+  void Move(int8_t step) {
+    record->on = true;
+    record->position += step;
+    record->steps += step < 0 ? -step : step;
+  }
+
+  StepperRecord* record;
+};
+
+struct RecordingServo {
+  void Init() {}
+
+  void Off() {}
+
+  // Only changes are recorded.
+  void Set(uint16_t v) {
+    if (values->empty() || values->back() != v) values->push_back(v);
+  }
+
+  std::vector<uint16_t>* values;
+};
+
+using HostDriver = Driver<VirtualTimer, RecordingStepper, RecordingStepper,
+                          RecordingServo>;
+
+// Same as the calibration of avr_board.h.
+inline CalibrationData HostCalibration() {
+  return CalibrationData{
+    .angle_offset = 0,
+    .left_fraction = 1 << 14,
+    .right_fraction = 1 << 14,
+    .pen_down = 1400,
+    .pen_up = 800,
+    .limits = {
+      {.max_v = 750, .max_a = 7500, .max_j = 0},  // kDrawMove
+      {.max_v = 750, .max_a = 7500, .max_j = 0},  // kTravelMove
+      {.max_v = 750, .max_a = 7500, .max_j = 0},  // kRotateMove
+    },
+    .supply = {
+      .mv = {2900, 3100, 3300, 3600},
+      .scale = {128, 128, 128, 128},
+    },
+    .coil_settle_ms = 0,
+  };
+}
+
+// Size of CalibrationData in the AVR firmware, which has no padding.
+constexpr size_t kAvrCalibrationSize = 47;
+
+// `calibration` as the AVR firmware stores it in EEPROM. Host structs are
+// padded differently, so fields are written one by one (little endian).
+inline std::vector<uint8_t> AvrCalibrationBytes(
+    const CalibrationData& calibration) {
+  std::vector<uint8_t> bytes;
+  auto put = [&](uint32_t v, int size) {
+    for (int i = 0; i < size; ++i) bytes.push_back(v >> (8 * i));
+  };
+  put(calibration.angle_offset, 2);
+  put(calibration.left_fraction, 2);
+  put(calibration.right_fraction, 2);
+  put(calibration.pen_down, 2);
+  put(calibration.pen_up, 2);
+  for (const MotionLimits& limits : calibration.limits) {
+    put(limits.max_v, 2);
+    put(limits.max_a, 2);
+    put(limits.max_j, 4);
+  }
+  for (uint16_t mv : calibration.supply.mv) put(mv, 2);
+  for (uint8_t scale : calibration.supply.scale) put(scale, 1);
+  put(calibration.coil_settle_ms, 1);
+  return bytes;
+}
+
+#endif  // HOST_BOARD_H_
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+
+#include <array>
+
+#include "../motors.h"
+
+namespace testing {
+
+struct TestGpio {
+  void ConfigureOutput() {}
+  void Set(bool v) {
+    *value = v;
+  }
+
+  bool* value;
+};
+
+// Runs PwmCoils::Tick() as the timer interrupt would and reads the coils.
+class PwmCoilsTest : public Test {
+ protected:
+  // As in main.cc.
+  static constexpr uint8_t kMicrosteps = 8;
+  static constexpr uint8_t kLevels = 16;
+  // Duty of both coils next to a half-step position.
+  static constexpr uint8_t kHalfDuty = 11;  // kLevels * cos(pi / 4)
+
+  using Coils = List<TestGpio, TestGpio, TestGpio, TestGpio>;
+
+  PwmCoilsTest()
+      : coils_(Coils(TestGpio{&out_[0]}, TestGpio{&out_[1]}, TestGpio{&out_[2]},
+                     TestGpio{&out_[3]})) {
+    coils_.Init();
+  }
+
+  void Tick(int ticks) {
+    for (int i = 0; i < ticks; ++i) coils_.Tick();
+    since_move_ += ticks;
+  }
+
+  // Moves by `delta` half-steps and waits until the coils get there. The
+  // microsteps of the last half-step are spread over the time since the
+  // previous move, the others follow each tick.
+  void Step(int8_t delta) {
+    int ticks = 2 * since_move_;
+    coils_.Move(delta);
+    since_move_ = 0;
+    Tick(ticks);
+  }
+
+  // Ticks of one PWM period each coil is on.
+  std::array<int, 4> Duty() {
+    std::array<int, 4> duty = {};
+    for (int i = 0; i < kLevels; ++i) {
+      Tick(1);
+      for (int c = 0; c < 4; ++c) duty[c] += out_[c];
+    }
+    return duty;
+  }
+
+  int since_move_ = 0;
+  bool out_[4] = {};
+  PwmCoils<Coils, kMicrosteps, kLevels> coils_;
+};
+
+TEST_F(PwmCoilsTest, HalfSteps) {
+  Step(0);
+  EXPECT_EQ(Duty(), (std::array<int, 4>{kLevels, 0, 0, 0}));
+  Step(1);
+  EXPECT_EQ(Duty(), (std::array<int, 4>{kHalfDuty, kHalfDuty, 0, 0}));
+  Step(1);
+  EXPECT_EQ(Duty(), (std::array<int, 4>{0, kLevels, 0, 0}));
+  Step(-3);
+  EXPECT_EQ(Duty(), (std::array<int, 4>{kHalfDuty, 0, 0, kHalfDuty}));
+  coils_.Off();
+  EXPECT_EQ(Duty(), (std::array<int, 4>{0, 0, 0, 0}));
+}
+
+TEST_F(PwmCoilsTest, SpreadsMicrosteps) {
+  constexpr int kInterval = 100;  // ticks between half-steps
+  coils_.Move(0);
+  coils_.Move(1);
+  Tick(kInterval);
+  // Microsteps of the next half-step follow each kInterval / kMicrosteps
+  // ticks, so it is only a quarter of the way after a quarter of the interval.
+  coils_.Move(1);
+  Tick(kInterval / 4);
+  std::array<int, 4> duty = Duty();
+  EXPECT_LT(duty[0], kHalfDuty);
+  EXPECT_GT(duty[0], 0);
+  EXPECT_GT(duty[1], kHalfDuty);
+  EXPECT_LT(duty[1], kLevels);
+  Tick(kInterval);
+  EXPECT_EQ(Duty(), (std::array<int, 4>{0, kLevels, 0, 0}));
+}
+
+TEST_F(PwmCoilsTest, HalfStepAfterPause) {
+  // Longer than 255 ticks per microstep.
+  constexpr int kPause = 300 * kMicrosteps;
+  coils_.Move(0);
+  Tick(kPause);
+  coils_.Move(1);
+  Tick(kPause);
+  EXPECT_EQ(Duty(), (std::array<int, 4>{kHalfDuty, kHalfDuty, 0, 0}));
+}
+
+}  // namespace testing
@@ -0,0 +1,38 @@
+// Replays the outputs of a simulated firmware, recorded by DrawingTest to
+// build/<test>.events, through the robot model without simavr:
+//
+//   build/replay build/smoke_test.events [output]
+//
+// The drawing is shown as in the tests and saved to <output>.pdf (by default
+// build/replay.pdf), the trace to <output>.trace.
+
+#include <stdio.h>
+
+#include <chrono>
+#include <string>
+
+#include "robot_sim.h"
+
+int main(int argc, char** argv) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "Usage: %s <events> [output]\n", argv[0]);
+    return 1;
+  }
+  std::string output = argc > 2 ? argv[2] : "build/replay";
+
+  testing::RobotSim robot(output);
+  robot.print_state_ = false;
+  auto start = std::chrono::steady_clock::now();
+  if (!testing::ReplayEvents(argv[1], &robot)) {
+    fprintf(stderr, "Cannot replay %s\n", argv[1]);
+    return 1;
+  }
+  std::chrono::duration<double> wall =
+      std::chrono::steady_clock::now() - start;
+  const testing::Point& p = robot.position_;
+  printf("Replayed in %.3lfs, final position [%.6lf, %.6lf, %.3lf]\n",
+         wall.count(), p.x, p.y, p.alpha / M_PI * 180.0);
+  robot.SaveTrace(output + ".trace");
+  robot.Finish();
+  return 0;
+}
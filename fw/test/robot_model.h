@@ -0,0 +1,385 @@
+#ifndef ROBOT_MODEL_H_
+#define ROBOT_MODEL_H_
+
+// Physics of the robot, without rendering, so that host tests can use it.
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "accuracy.h"
+#include "event_log.h"
+
+namespace testing {
+
+class Wheel {
+ public:
+  // f is maximum force of a single coil
+  Wheel(int num_coils, bool* coils, int32_t* requested_steps,
+        double l, double r, double u, double d,
+        double m, double f, uint32_t t_0, double buffer)
+      : NumCoils(num_coils),
+        coils_(coils),
+        requested_steps_(requested_steps),
+        L(l),
+        R(r),
+        U(u),
+        D(d),
+        Do(2 * d),
+        P(num_coils * d),
+        M(m),
+        Fr(0.1 * f),
+        last_update_(t_0),
+        i_(num_coils, 0.0),
+        i_final_(num_coils, 0.0),
+        max_buffer_(buffer) {
+    double max_i = U / R;
+
+    double max_r;
+
+    /*
+    max_r = Do * sqrt(1.5);
+    double alpha1 = (f / max_i) * max_r * max_r * max_r / sqrt(max_r * max_r - Do * Do);
+    */
+
+    max_r = sqrt(d * d + Do * Do);
+    double alpha2 = (f / max_i) * max_r * max_r * max_r / sqrt(max_r * max_r - Do * Do);
+
+    //alpha_ = (alpha1 + alpha2) * 0.5;  // approximate guess to compensate for further positions.
+    alpha_ = alpha2;
+//    printf("alpha: f = %.6lf, maxi = %.6lf, maxr = %.6lf, Do = %.6lf\n", f, max_i, max_r, Do);
+  }
+
+  const bool* Coils() const {
+    return coils_;
+  }
+
+  int32_t RequestedSteps() const {
+    return *requested_steps_;
+  }
+
+  double Position() const {
+    return s_final_;
+  }
+
+  double Velocity() const {
+    return v_final_;
+  }
+
+  double Current(int c) const {
+    return i_[c];
+  }
+
+  void Update(uint32_t t) {
+    double dt = (t - last_update_) / static_cast<double>(F_CPU);
+    last_update_ = t;
+    if (dt <= 0.0) return;
+
+    // Coil voltages do not change between updates, so the currents follow the
+    // exact solution of the RL circuit, see CoilForce().
+    for (int c = 0; c < NumCoils; ++c) {
+      i_final_[c] = coils_[c] ? U / R : 0.0;
+    }
+
+    double s_prev = s_;
+    Integrate(dt);
+    double decay = exp(-dt * R / L);
+    for (int c = 0; c < NumCoils; ++c) {
+      i_[c] = i_final_[c] + (i_[c] - i_final_[c]) * decay;
+    }
+
+    double ds = s_ - s_prev;
+    buffer_ += ds;
+    buffer_ = std::min(buffer_, max_buffer_);
+    buffer_ = std::max(buffer_, -max_buffer_);
+    s_prev = s_final_;
+    s_final_ = s_ + P * periods_ - buffer_;
+    v_final_ = (s_final_ - s_prev) / dt;
+
+    while (s_ < 0.0) {
+      s_ += P;
+      periods_--;
+    }
+    while (s_ > P) {
+      s_ -= P;
+      periods_++;
+    }
+  }
+
+ private:
+  // Local error allowed in one step of Integrate().
+  static constexpr double kPositionTolerance = 1e-9;  // 1nm
+  static constexpr double kVelocityTolerance = 1e-6;  // 1um/s
+  // Steps are accepted regardless of the error at this length, which happens
+  // when the friction changes direction.
+  static constexpr double kMinStep = 1e-7;  // 100ns
+
+  // Force of the coils at position `s`, `t` after the last update. Each coil
+  // acts from its nearest position, so the loop has no branches.
+  double CoilForce(double t, double s) const {
+    double decay = exp(-t * R / L);
+    double f = 0.0;
+    for (int c = 0; c < NumCoils; ++c) {
+      double x = c * D - s;
+      x -= P * floor(x / P + 0.5);
+      double r2 = x * x + Do * Do;
+      double i = i_final_[c] + (i_[c] - i_final_[c]) * decay;
+      f += i * x / (r2 * sqrt(r2));
+    }
+    return f * alpha_;
+  }
+
+  double Acceleration(double t, double s, double v) const {
+    double f = CoilForce(t, s);
+    // Very small friction force dependent on velocity, and a constant one,
+    // which holds the wheel in place unless the coils overcome it.
+    if (v > 0) {
+      f += -Fr - v * Fr;
+    } else if (v < 0) {
+      f += Fr - v * Fr;
+    } else {
+      f -= std::clamp(f, -Fr, Fr);
+    }
+    return f / M;
+  }
+
+  // Advances position and velocity by `dt` with the Bogacki-Shampine method,
+  // adapting the step length to the error estimate. The step length carries
+  // over to the next update.
+  void Integrate(double dt) {
+    double t = 0.0;
+    double a = Acceleration(t, s_, v_);
+    while (t < dt) {
+      double h = std::min(step_, dt - t);
+      double a2 = Acceleration(t + 0.5 * h, s_ + 0.5 * h * v_,
+                               v_ + 0.5 * h * a);
+      double v2 = v_ + 0.5 * h * a;
+      double a3 = Acceleration(t + 0.75 * h, s_ + 0.75 * h * v2,
+                               v_ + 0.75 * h * a2);
+      double v3 = v_ + 0.75 * h * a2;
+      double s = s_ + h * (2.0 / 9 * v_ + 1.0 / 3 * v2 + 4.0 / 9 * v3);
+      double v = v_ + h * (2.0 / 9 * a + 1.0 / 3 * a2 + 4.0 / 9 * a3);
+      double a4 = Acceleration(t + h, s, v);
+      // Difference to the embedded 2nd order solution.
+      double es = h * (-5.0 / 72 * v_ + 1.0 / 12 * v2 + 1.0 / 9 * v3 -
+                       1.0 / 8 * v);
+      double ev = h * (-5.0 / 72 * a + 1.0 / 12 * a2 + 1.0 / 9 * a3 -
+                       1.0 / 8 * a4);
+      double error = std::max(fabs(es) / kPositionTolerance,
+                              fabs(ev) / kVelocityTolerance);
+      double scale = 0.9 * pow(std::max(error, 1e-6), -1.0 / 3);
+      if (error > 1.0 && h > kMinStep) {
+        step_ = std::max(h * std::max(scale, 0.2), kMinStep);
+        continue;
+      }
+      t += h;
+      if (h == step_) step_ = h * std::min(scale, 5.0);
+      if ((v_ > 0 && v < 0) || (v_ < 0 && v > 0)) {
+        // Friction stops the wheel before it turns back.
+        v = 0.0;
+        a4 = Acceleration(t, s, v);
+      }
+      s_ = s;
+      v_ = v;
+      a = a4;
+    }
+  }
+
+  const int NumCoils;
+  bool* coils_;
+  int32_t* requested_steps_;
+
+  const double L;  // inductance of the coil
+  const double R;  // resistance of the coil
+  const double U;  // voltage when the coil is on
+  const double D;  // distance between coils.
+  const double Do; // offset distance between coil and stator, assume 0.2 * D
+  const double P;  // perimeter = NumCoils * D
+  const double M;  // mass
+  const double Fr;   // Friction force
+  double alpha_;  // F = I * alpha / r^2
+
+  uint32_t last_update_;
+
+  double s_ = 0.0;
+  int32_t periods_ = 0;
+  double v_ = 0.0;
+  std::vector<double> i_;
+  std::vector<double> i_final_;  // currents the coils settle at
+  double step_ = 1e-5;  // of Integrate()
+
+  double v_final_ = 0.0;
+  double s_final_ = 0.0;
+  double buffer_ = 0;
+  double max_buffer_;
+};
+
+// Parameters of the stepper motors, see Wheel.
+struct WheelModel {
+  double l = 0.022;  // 220mH
+  double r = 50.0;  // Ohm
+  double u = 5.0;  // V
+  double d = 0.000077466;  // 78um
+  double m = 0.05;  // 50g
+  double f = 1.36;  // N
+  double buffer = 1e-8;
+};
+
+// Moves the robot by the outputs of the firmware, which it reads through the
+// pointers given to Start(), and records its trace.
+class RobotModel {
+ public:
+  static constexpr int kNumCoils = 4;
+
+  void Start(bool* left_coils, int32_t* left_steps, bool* right_coils,
+             int32_t* right_steps, bool* servo_on, uint16_t* servo_state,
+             uint32_t cycle) {
+    servo_on_ = servo_on;
+    servo_state_ = servo_state;
+
+    const WheelModel& w = wheel_model_;
+    left_ = std::make_unique<Wheel>(kNumCoils, left_coils, left_steps,
+        w.l, w.r, w.u, w.d, w.m, w.f, cycle, w.buffer);
+    right_ = std::make_unique<Wheel>(kNumCoils, right_coils, right_steps,
+        w.l, w.r, w.u, w.d, w.m, w.f, cycle, w.buffer);
+
+    last_print_ = last_cycle_ = cycle;
+    trace_.clear();
+    length_since_trace_ = 0.0;
+  }
+
+  // Writes the trace as "x y alpha pendown" lines.
+  void SaveTrace(const std::string& filename) const {
+    FILE* f = fopen(filename.c_str(), "w");
+    if (f == nullptr) return;
+    for (const Point& p : trace_) {
+      fprintf(f, "%.6lf %.6lf %.6lf %d\n", p.x, p.y, p.alpha, p.pendown);
+    }
+    fclose(f);
+  }
+
+  // Advances the robot to `cycle`, with the outputs constant since the last
+  // update.
+  void Update(uint32_t cycle) {
+    left_->Update(cycle);
+    right_->Update(cycle);
+
+    double v = 0.5 * (right_->Velocity() - left_->Velocity());
+    double dt = static_cast<double>(cycle - last_cycle_) / F_CPU;
+
+    position_.x += v * cos(position_.alpha) * dt;
+    position_.y += v * sin(position_.alpha) * dt;
+
+    double omega = (right_->Velocity() + left_->Velocity()) / kWheelDistance;
+    position_.alpha += omega * dt;
+
+    if (*servo_on_) {
+      position_.pendown = *servo_state_ > 1300;
+    }
+
+    length_since_trace_ +=
+        (fabs(left_->Velocity()) + fabs(right_->Velocity())) * dt;
+    last_cycle_ = cycle;
+
+    // Update output after each 2 mm
+    if (length_since_trace_ > 0.002 ||
+        (!trace_.empty() && trace_.back().pendown != position_.pendown)) {
+      trace_.push_back(position_);
+      length_since_trace_ = 0.0;
+    }
+
+    // Debug state each 100ms
+    if (print_state_ && last_cycle_ - last_print_ > F_CPU / 10) {
+      last_print_ = last_cycle_;
+      printf("%9u: ", cycle);
+      printf(" [%.8lf, %.8lf, %.8lf] ", position_.x, position_.y,
+             position_.alpha / 3.14159 * 180.0);
+      if (*servo_on_) {
+        printf("%5d", *servo_state_);
+      } else {
+        printf("(off)");
+      }
+      for (const auto* c : {left_.get(), right_.get()}) {
+        printf("    ");
+        for (int i = 0; i < 4; ++i) {
+          printf(" %s,%.3lf", c->Coils()[i] ? " on": "off", c->Current(i));
+        }
+        printf("  %.6lf %.3lf", c->Position(), c->Velocity());
+        printf("  avg speed: %.3lf", c->Position() / cycle * F_CPU);
+        printf("  position ratio: %.3lf vs. %.2lf", c->Position() / 0.000077466,
+               c->RequestedSteps() / 2.0);
+      }
+      printf("\n");
+    }
+  }
+
+
+  static constexpr double kWheelDistance = 0.0772;
+  // Longest step of the physics between changes of the outputs, in cycles.
+  // Wheel integrates with its own steps, this only limits the error of the
+  // robot position and of the trace.
+  static constexpr uint32_t kMaxPhysicsStep = F_CPU / 2000;  // 500us
+// With error:
+//  static constexpr double kWheelDistance = 0.08;
+
+  WheelModel wheel_model_;  // set before Start()
+  bool print_state_ = true;  // each 100ms of robot time
+
+  bool* servo_on_;
+  uint16_t* servo_state_;
+
+  std::unique_ptr<Wheel> left_;
+  std::unique_ptr<Wheel> right_;
+
+  Point position_;
+  uint32_t last_cycle_;
+  uint32_t last_print_;
+
+  std::vector<Point> trace_;
+  double length_since_trace_;
+};
+
+// Runs the robot with the outputs recorded by DrawingSim::RecordEvents().
+// Physics steps end at each change of the outputs and are at most
+// kMaxPhysicsStep long. The simulation also ended steps where the firmware
+// signalled a change that did not happen, which the log does not keep, so the
+// replayed positions are close to the recorded ones but not bit-identical.
+// Returns false if the log is broken.
+//
+// Robot: RobotModel or a class derived from it.
+template <typename Robot>
+bool ReplayEvents(const std::string& filename, Robot* robot) {
+  EventLogReader log;
+  uint32_t cycle;
+  if (!log.Open(filename, &cycle)) return false;
+  bool left_coils[RobotModel::kNumCoils] = {};
+  bool right_coils[RobotModel::kNumCoils] = {};
+  int32_t left_steps = 0;
+  int32_t right_steps = 0;
+  bool servo_on = false;
+  uint16_t servo_state = 0;
+  robot->Start(left_coils, &left_steps, right_coils, &right_steps, &servo_on,
+               &servo_state, cycle);
+  OutputEvent event;
+  uint32_t event_cycle;
+  while (log.Next(&event_cycle, &event)) {
+    while (event_cycle - cycle > RobotModel::kMaxPhysicsStep) {
+      cycle += RobotModel::kMaxPhysicsStep;
+      robot->Update(cycle);
+    }
+    if (event_cycle != cycle) {
+      cycle = event_cycle;
+      robot->Update(cycle);
+    }
+    event.ToState(left_coils, right_coils, &servo_on, &servo_state);
+  }
+  return log.AtEnd();
+}
+
+}  // namespace testing
+
+#endif  // ROBOT_MODEL_H_
@@ -0,0 +1,126 @@
+#ifndef ROBOT_SIM_H_
+#define ROBOT_SIM_H_
+
+#include <math.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "robot_model.h"
+#include "window.h"
+
+namespace testing {
+
+// Simulates the robot from the outputs of the firmware, which it reads through
+// the pointers given to Start(), and draws its trace. The drawing is saved to
+// <output>.pdf by Finish().
+class RobotSim : public RobotModel {
+ public:
+  RobotSim(const std::string& output)
+      : out_filename_(output + std::string(".pdf")) {}
+
+  void Start(bool* left_coils, int32_t* left_steps, bool* right_coils,
+             int32_t* right_steps, bool* servo_on, uint16_t* servo_state,
+             uint32_t cycle) {
+    RobotModel::Start(left_coils, left_steps, right_coils, right_steps,
+                      servo_on, servo_state, cycle);
+
+    // A3 paper, 10mm borders
+    window_ = std::make_unique<Window>(-0.1485, 0.1485, -0.210, 0.210, 0.010,
+                                       0.010, offscreen_);
+    window_->draw = [&](cairo_t *cr) {
+      DrawTrace(cr, 0, trace_.size());
+    };
+    window_->overlay = [&](cairo_t *cr) {
+      if (!trace_.empty()) {
+        constexpr double kArrowLength = 0.020;   // 20mm
+        const Point& last = trace_[trace_.size() - 1];
+        cairo_set_line_width(cr, 0.0005);
+        cairo_set_source_rgb(cr, 0, 1, 0);
+        cairo_move_to(cr, last.x, last.y);
+        cairo_line_to(cr, last.x + cos(last.alpha) * kArrowLength,
+                      last.y + sin(last.alpha) * kArrowLength);
+        cairo_stroke(cr);
+      }
+
+    };
+
+    shown_points_ = 0;
+    last_frame_ = std::chrono::steady_clock::now();
+  }
+
+  void Finish() {
+    ShowFrame();
+    window_->show(true);
+    window_->savePDF(out_filename_.c_str());
+  }
+
+  // Advances the robot to `cycle`, with the outputs constant since the last
+  // update.
+  void Update(uint32_t cycle) {
+    RobotModel::Update(cycle);
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_frame_ > kFramePeriod) {
+      last_frame_ = now;
+      ShowFrame();
+      window_->show(false);
+    }
+  }
+
+  // Strokes the segments of the trace ending at points [begin, end).
+  void DrawTrace(cairo_t* cr, size_t begin, size_t end) {
+    auto set_color = [&](bool pendown) {
+      if (pendown) {
+        cairo_set_source_rgb(cr, 1, 0, 0);
+      } else {
+        cairo_set_source_rgb(cr, 0.8, 0.8, 1);
+      }
+    };
+    cairo_set_line_width(cr, 0.0005);  // 0.5mm tip
+    cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
+    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+    // Starts at the origin with pen down.
+    Point prev = begin == 0 ? Point() : trace_[begin - 1];
+    bool pendown = prev.pendown;
+    set_color(pendown);
+    cairo_move_to(cr, prev.x, prev.y);
+    for (size_t i = begin; i < end; ++i) {
+      const Point& p = trace_[i];
+      if (pendown != p.pendown) {
+        cairo_stroke(cr);
+        pendown = p.pendown;
+        set_color(pendown);
+        cairo_move_to(cr, p.x, p.y);
+      } else {
+        cairo_line_to(cr, p.x, p.y);
+      }
+    }
+    cairo_stroke(cr);
+  }
+
+  // Adds the new part of the trace to the window.
+  void ShowFrame() {
+    size_t end = trace_.size();
+    if (end == shown_points_) return;
+    window_->append([&](cairo_t* cr) { DrawTrace(cr, shown_points_, end); });
+    shown_points_ = end;
+    window_->present();
+  }
+
+  bool offscreen_ = false;  // see Window
+
+  const std::string out_filename_;
+
+  // The window is updated at most this often, by the part of the trace drawn
+  // since the last update.
+  static constexpr std::chrono::milliseconds kFramePeriod{40};
+
+  std::unique_ptr<Window> window_;
+  size_t shown_points_;  // points of trace_ already in the window
+  std::chrono::steady_clock::time_point last_frame_;
+};
+
+}  // namespace testing
+
+#endif  // ROBOT_SIM_H_
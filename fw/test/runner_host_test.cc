@@ -0,0 +1,164 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "host_board.h"
+#include "robot_model.h"
+#include "../generators.h"
+#include "../../gendata/example-a4.h"
+
+namespace testing {
+
+// The images of runner_test drawn by the firmware Driver on the host: the
+// coils are driven by the real Stepper, their outputs are logged to
+// build/runner_host_test.events and replayed through RobotModel, and the
+// trace is compared with the image. Each job runs with a short and a long
+// iteration of the motion loop, as the AVR takes between them.
+
+// Outputs of the firmware, logged on each change.
+struct LoggedOutputs {
+  void Changed() {
+    log.Write(VirtualTimer::now,
+              OutputEvent::FromState(left, right, servo_on, servo));
+  }
+
+  bool left[RobotModel::kNumCoils] = {};
+  bool right[RobotModel::kNumCoils] = {};
+  bool servo_on = false;
+  uint16_t servo = 0;
+  EventLogWriter log;
+};
+
+LoggedOutputs* outputs;  // of the running job
+
+struct LoggedGpio {
+  void ConfigureOutput() {}
+
+  void Set(bool v) {
+    *value = v;
+    outputs->Changed();
+  }
+
+  bool* value;
+};
+
+struct LoggedServo {
+  void Init() {}
+
+  void Off() {
+    outputs->servo_on = false;
+    outputs->Changed();
+  }
+
+  void Set(uint16_t v) {
+    outputs->servo_on = true;
+    outputs->servo = v;
+    outputs->Changed();
+  }
+};
+
+using LoggedCoils = List<LoggedGpio, LoggedGpio, LoggedGpio, LoggedGpio>;
+using LoggedDriver = Driver<VirtualTimer, Stepper<LoggedCoils>,
+                            Stepper<LoggedCoils>, LoggedServo>;
+
+LoggedCoils Coils(bool* c) {
+  return LoggedCoils(LoggedGpio{&c[0]}, LoggedGpio{&c[1]}, LoggedGpio{&c[2]},
+                     LoggedGpio{&c[3]});
+}
+
+struct HostRunnerImage {
+  const char* name;
+  std::vector<Segment> (*intended)();
+  bool (*draw)(LoggedDriver* driver);
+};
+
+template <typename Source>
+bool DrawSource(LoggedDriver* driver, Source source) {
+  DrawProgress progress = {};
+  return driver->DrawImage([]() { return false; }, &source, &progress,
+                           [](const DrawProgress&, bool) {});
+}
+
+const HostRunnerImage kImages[] = {
+  {"example", [] { return IntendedSegments(ImageReader(&kExample)); },
+   [](LoggedDriver* d) { return DrawSource(d, ImageReader(&kExample)); }},
+  {"spiral", [] { return IntendedSegments(CurveSource(SpiralCurve(1))); },
+   [](LoggedDriver* d) { return DrawSource(d, CurveSource(SpiralCurve(1))); }},
+  {"hilbert", [] { return IntendedSegments(CurveSource(HilbertCurve(1))); },
+   [](LoggedDriver* d) {
+     return DrawSource(d, CurveSource(HilbertCurve(1)));
+   }},
+};
+
+// As in runner_test.cc.
+CalibrationData FastCalibration() {
+  CalibrationData c = HostCalibration();
+  for (MotionLimits& l : c.limits) {
+    l.max_v *= 2;
+    l.max_a *= 2;
+  }
+  return c;
+}
+
+struct HostRunnerJob {
+  const char* calibration;
+  bool fast;
+  const char* wheel;
+  WheelModel model;
+  uint32_t read_cycles;
+};
+
+Accuracy RunJob(const HostRunnerImage& image, const HostRunnerJob& job) {
+  const std::string events = "build/runner_host_test.events";
+  CalibrationData calibration =
+      job.fast ? FastCalibration() : HostCalibration();
+  VirtualTimer::now = 0;
+  VirtualTimer::read_cycles = job.read_cycles;
+  LoggedOutputs logged;
+  outputs = &logged;
+  EXPECT_TRUE(logged.log.Open(events, VirtualTimer::now));
+  {
+    LoggedDriver driver(VirtualTimer(), Stepper(Coils(logged.left)),
+                        Stepper(Coils(logged.right)), LoggedServo(),
+                        &calibration);
+    driver.Init();
+    EXPECT_TRUE(image.draw(&driver));
+  }
+  logged.log.Close(VirtualTimer::now);
+  outputs = nullptr;
+
+  RobotModel robot;
+  robot.print_state_ = false;
+  robot.wheel_model_ = job.model;
+  EXPECT_TRUE(ReplayEvents(events, &robot));
+  return CompareDrawings(image.intended(), TraceSegments(robot.trace_));
+}
+
+TEST(RunnerHostTest, AllJobs) {
+  const HostRunnerJob kJobs[] = {
+    {"nominal", false, "nominal", {}, 256},  // 64us per iteration
+    {"nominal", false, "nominal", {}, 1024},  // 256us
+    {"nominal", false, "heavy", {.m = 0.1}, 256},
+    {"nominal", false, "heavy", {.m = 0.1}, 1024},
+    {"fast", true, "nominal", {}, 256},
+    {"fast", true, "nominal", {}, 1024},
+    {"fast", true, "heavy", {.m = 0.1}, 256},
+    {"fast", true, "heavy", {.m = 0.1}, 1024},
+  };
+  printf("%-8s %-8s %-8s %6s %8s %8s\n", "image", "calib", "wheel", "loop",
+         "max[mm]", "mean[mm]");
+  for (const HostRunnerImage& image : kImages) {
+    for (const HostRunnerJob& job : kJobs) {
+      Accuracy a = RunJob(image, job);
+      printf("%-8s %-8s %-8s %4uus %8.3lf %8.3lf\n", image.name,
+             job.calibration, job.wheel, job.read_cycles / (F_CPU / 1000000),
+             a.hausdorff * 1000, a.mean * 1000);
+      EXPECT_LT(a.hausdorff, kMaxHausdorff) << image.name;
+      EXPECT_LT(a.mean, kMaxMeanDeviation) << image.name;
+    }
+  }
+}
+
+}  // namespace testing
@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "drawing_sim.h"
+#include "host_board.h"
+#include "../generators.h"
+#include "../../gendata/image-a4.h"
+
+namespace testing {
+
+// Draws each combination of image, calibration and wheel model in its own
+// simavr instance, several at a time. Each run writes
+// build/runner_test_<job>.pdf and .trace (see DrawingSim::SaveTrace), and
+// the drawing must stay within kMaxHausdorff and kMaxMeanDeviation of the
+// image (accuracy.h).
+
+struct RunnerImage {
+  const char* name;
+  uint8_t image;  // see runner_test_avr.cc
+  std::vector<Segment> (*intended)();
+};
+
+const RunnerImage kImages[] = {
+  {"example", 0, [] { return IntendedSegments(ImageReader(&kExample)); }},
+  {"spiral", 1, [] { return IntendedSegments(CurveSource(SpiralCurve(1))); }},
+  {"hilbert", 2,
+   [] { return IntendedSegments(CurveSource(HilbertCurve(1))); }},
+};
+
+struct RunnerCalibration {
+  const char* name;
+  CalibrationData data;
+};
+
+const RunnerCalibration kCalibrations[] = {
+  {"nominal", HostCalibration()},
+  {"fast", [] {
+    CalibrationData c = HostCalibration();
+    for (MotionLimits& l : c.limits) {
+      l.max_v *= 2;
+      l.max_a *= 2;
+    }
+    return c;
+  }()},
+};
+
+struct RunnerWheel {
+  const char* name;
+  WheelModel model;
+};
+
+const RunnerWheel kWheels[] = {
+  {"nominal", {}},
+  {"heavy", {.m = 0.1}},  // 100g
+};
+
+struct RunnerJob {
+  const RunnerImage* image;
+  const RunnerCalibration* calibration;
+  const RunnerWheel* wheel;
+
+  // Results
+  uint8_t state = 0;
+  Point position;
+  Accuracy accuracy = {};
+  double simulated = 0.0;  // s
+  double wall = 0.0;  // s
+};
+
+void RunJob(int index, RunnerJob* job) {
+  std::string output = "build/runner_test_" + std::to_string(index);
+  DrawingSim sim("runner_test", output);
+  sim.verbose_ = false;
+  sim.offscreen_ = true;
+  sim.wheel_model_ = job->wheel->model;
+
+  auto start = std::chrono::steady_clock::now();
+  sim.Load();
+  // Read by the constructor of the driver, which runs in the first Run().
+  sim.SetEepromVar("kCalibrationData",
+                   AvrCalibrationBytes(job->calibration->data));
+  EXPECT_EQ(sim.Run(), cpu_Running);
+  EXPECT_EQ(*sim.avr_state_, 1);
+  *sim.GetVar<uint8_t>("image") = job->image->image;
+  EXPECT_EQ(sim.Run(), cpu_Running);
+  job->state = *sim.avr_state_;
+  sim.Finish();
+  sim.SaveTrace(output + ".trace");
+  std::chrono::duration<double> wall =
+      std::chrono::steady_clock::now() - start;
+
+  job->position = sim.position_;
+  job->accuracy = CompareDrawings(job->image->intended(),
+                                  TraceSegments(sim.trace_));
+  job->simulated = sim.avr_->cycle / static_cast<double>(F_CPU);
+  job->wall = wall.count();
+}
+
+TEST(RunnerTest, AllJobs) {
+  std::vector<RunnerJob> jobs;
+  for (const RunnerImage& image : kImages) {
+    for (const RunnerCalibration& calibration : kCalibrations) {
+      for (const RunnerWheel& wheel : kWheels) {
+        RunnerJob& job = jobs.emplace_back();
+        job.image = &image;
+        job.calibration = &calibration;
+        job.wheel = &wheel;
+      }
+    }
+  }
+
+  std::atomic<size_t> next = 0;
+  std::vector<std::thread> workers;
+  unsigned num_threads =
+      std::clamp<unsigned>(std::thread::hardware_concurrency(), 1, jobs.size());
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < num_threads; ++i) {
+    workers.emplace_back([&]() {
+      for (size_t j; (j = next++) < jobs.size();) RunJob(j, &jobs[j]);
+    });
+  }
+  for (std::thread& w : workers) w.join();
+  std::chrono::duration<double> wall =
+      std::chrono::steady_clock::now() - start;
+
+  printf("%3s  %-8s %-8s %-8s %5s %8s %8s %8s %8s %8s %8s %8s\n", "job",
+         "image", "calib", "wheel", "state", "x[mm]", "y[mm]", "head[deg]",
+         "max[mm]", "mean[mm]", "sim[s]", "wall[s]");
+  double simulated = 0.0;
+  for (size_t j = 0; j < jobs.size(); ++j) {
+    const RunnerJob& job = jobs[j];
+    printf("%3zu  %-8s %-8s %-8s %5d %8.2lf %8.2lf %8.2lf %8.3lf %8.3lf "
+           "%8.2lf %8.2lf\n",
+           j, job.image->name, job.calibration->name, job.wheel->name,
+           job.state, job.position.x * 1000, job.position.y * 1000,
+           job.position.alpha / M_PI * 180.0, job.accuracy.hausdorff * 1000,
+           job.accuracy.mean * 1000, job.simulated, job.wall);
+    simulated += job.simulated;
+    EXPECT_EQ(job.state, 2) << "job " << j;
+    EXPECT_LT(job.accuracy.hausdorff, kMaxHausdorff) << "job " << j;
+    EXPECT_LT(job.accuracy.mean, kMaxMeanDeviation) << "job " << j;
+  }
+  printf("%zu jobs on %u threads: %.2lfs simulated in %.2lfs (%.2lfx)\n",
+         jobs.size(), num_threads, simulated, wall.count(),
+         simulated / wall.count());
+}
+
+}  // namespace testing
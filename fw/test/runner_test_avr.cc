@@ -0,0 +1,29 @@
+#include "avr_board.h"
+#include "../generators.h"
+#include "../../gendata/image-a4.h"
+
+// Input: The image to draw, set by the host (runner_test.cc) while state is 1.
+volatile uint8_t image USED;
+
+int main() {
+  state = 1;
+  auto intr = []() { return false; };
+  DrawProgress progress = {};
+  auto save_progress = [](const DrawProgress&, bool) {};
+  auto draw = [&](auto source) {
+    return driver.DrawImage(intr, &source, &progress, save_progress);
+  };
+  switch (image) {
+    case 0:
+      draw(ImageReader(&kExample));
+      break;
+    case 1:
+      draw(CurveSource(SpiralCurve(1)));
+      break;
+    default:
+      draw(CurveSource(HilbertCurve(1)));
+      break;
+  }
+  state = 2;
+  return 0;
+}
@@ -0,0 +1,152 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <simavr/avr_uart.h>
+#include <simavr/sim_io.h>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "avr_test.h"
+#include "../../stream/sender.h"
+
+namespace testing {
+
+// The host tool is replaced by StreamSender talking to the simulated uart.
+class StreamTest : public AvrTest {
+ protected:
+  StreamTest() : AvrTest("stream_test") {}
+
+  void SetUp() override {
+    AvrTest::SetUp();
+    points_drawn_ = GetVar<uint16_t>("points_drawn");
+    points_sum_ = GetVar<uint16_t>("points_sum");
+
+    // Do not print the uart output.
+    uint32_t flags = 0;
+    avr_ioctl(avr_, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr_, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+
+    input_ = avr_io_getirq(avr_, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+    avr_irq_register_notify(
+        avr_io_getirq(avr_, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT),
+        &Output, this);
+
+    for (int i = 0; i < kNumPoints; ++i) {
+      points_.push_back({static_cast<int16_t>(10 + i % 7),
+                         static_cast<int16_t>(i % 3 == 0 ? 0 : 8 - i % 17),
+                         i % 5 != 0});
+    }
+  }
+
+  // Sends the points; each frame is sent `delay_ms` after the previous one.
+  void Stream(uint8_t frame_points, uint64_t delay_ms) {
+    sender_ = std::make_unique<StreamSender>(points_, frame_points, 100);
+    delay_ms_ = delay_ms;
+    EXPECT_EQ(Run(), cpu_Running);
+    EXPECT_EQ(*avr_state_, 1);
+    EXPECT_EQ(Run(), cpu_Running);
+    EXPECT_EQ(*avr_state_, 2);
+
+    EXPECT_TRUE(sender_->Done());
+    EXPECT_EQ(*points_drawn_, kNumPoints);
+    uint16_t sum = 0;
+    for (const StreamPoint& p : points_) sum += p.len + p.angle + p.pen;
+    EXPECT_EQ(*points_sum_, sum);
+  }
+
+  static void Output(avr_irq_t*, uint32_t value, void* param) {
+    StreamTest* t = static_cast<StreamTest*>(param);
+    if (t->drop_next_report_ && value <= kStreamMaxFree) {
+      t->drop_next_report_ = false;
+      return;
+    }
+    if ((value & ~kStreamAckSequence) == kStreamAck &&
+        ++t->acks_ == t->drop_ack_) {
+      // The frame is sent again after the timeout.
+      t->corrupt_next_frame_ = t->corrupt_resend_;
+      return;
+    }
+    t->sender_->Receive(value);
+  }
+
+  void StepDone() override {
+    uint64_t now_ms = avr_->cycle / (F_CPU / 1000);
+    if (pending_.empty() && now_ms >= next_frame_ms_) {
+      std::vector<uint8_t> frame = sender_->Send(now_ms);
+      if (!frame.empty()) {
+        if (corrupt_next_frame_) {
+          frame.back() ^= 0xff;
+          corrupt_next_frame_ = false;
+        }
+        pending_.insert(pending_.end(), frame.begin(), frame.end());
+        next_frame_ms_ = now_ms + delay_ms_;
+      }
+    }
+    // Feed the bytes slower than the uart receives them.
+    if (!pending_.empty() && avr_->cycle >= next_byte_cycle_) {
+      avr_raise_irq(input_, pending_.front());
+      pending_.pop_front();
+      next_byte_cycle_ = avr_->cycle + kByteCycles;
+    }
+  }
+
+  static constexpr int kNumPoints = 40;
+  static constexpr uint64_t kByteCycles = 400;
+
+  uint16_t* points_drawn_;
+  uint16_t* points_sum_;
+  avr_irq_t* input_;
+
+  std::vector<StreamPoint> points_;
+  std::unique_ptr<StreamSender> sender_;
+  std::deque<uint8_t> pending_;
+  uint64_t delay_ms_ = 0;
+  uint64_t next_frame_ms_ = 0;
+  uint64_t next_byte_cycle_ = 0;
+  bool corrupt_next_frame_ = false;
+  bool drop_next_report_ = false;  // of free space, from the robot
+  int acks_ = 0;
+  int drop_ack_ = 0;  // number of the acknowledgement to drop, 0 for none
+  bool corrupt_resend_ = false;  // of the frame whose acknowledgement dropped
+};
+
+TEST_F(StreamTest, FastHost) {
+  Stream(kStreamMaxFramePoints, 0);
+}
+
+// The robot runs out of points and waits for each one.
+TEST_F(StreamTest, SlowHost) {
+  Stream(1, 150);
+}
+
+TEST_F(StreamTest, CorruptedFrameIsSentAgain) {
+  corrupt_next_frame_ = true;
+  Stream(kStreamMaxFramePoints, 0);
+  EXPECT_GE(sender_->Resends(), 1u);
+}
+
+// The host gets no credits from the first report, the periodic one follows.
+TEST_F(StreamTest, LostReport) {
+  drop_next_report_ = true;
+  Stream(kStreamMaxFramePoints, 0);
+}
+
+// The second frame fills the buffer, so its repeat does not fit anymore.
+TEST_F(StreamTest, LostAck) {
+  drop_ack_ = 2;
+  Stream(kStreamMaxFramePoints, 0);
+  EXPECT_GE(sender_->Resends(), 1u);
+}
+
+// The robot rejects the repeat, the host must send the same frame again.
+TEST_F(StreamTest, LostAckAndCorruptedRepeat) {
+  drop_ack_ = 2;
+  corrupt_resend_ = true;
+  Stream(kStreamMaxFramePoints, 0);
+  EXPECT_GE(sender_->Resends(), 2u);
+}
+
+}  // namespace testing
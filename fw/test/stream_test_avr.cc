@@ -0,0 +1,64 @@
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+#include "avr_board.h"
+#include "../stream.h"
+
+// Output: Points taken from the stream and their checksum.
+volatile uint16_t points_drawn USED;
+volatile uint16_t points_sum USED;
+
+// Fastest baud rate, simavr does not need a real one.
+struct Uart {
+  static void Init() {
+    UBRR0 = 0;
+    UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
+  }
+
+  static bool CanWrite() {
+    return UCSR0A & _BV(UDRE0);
+  }
+
+  static void Write(uint8_t b) {
+    UDR0 = b;
+  }
+};
+
+StreamReceiver<Uart, 32> stream;
+
+#ifdef USART0_RX_vect
+ISR(USART0_RX_vect) {
+#else
+ISR(USART_RX_vect) {
+#endif
+  stream.RxIrq(UDR0);
+}
+
+struct CountingStream {
+  bool Pop(DataPoint* p) {
+    if (!stream.Pop(p)) return false;
+    points_drawn = points_drawn + 1;
+    points_sum = points_sum + p->len + p->angle + p->pen;
+    return true;
+  }
+
+  bool Done() const {
+    return stream.Done();
+  }
+
+  void Poll() {
+    stream.Poll();
+  }
+};
+
+int main() {
+  state = 1;
+  Uart::Init();
+  sei();
+  stream.Start();
+  CountingStream counting;
+  auto intr = []() { return false; };
+  bool ok = driver.DrawStream(intr, &counting);
+  state = ok ? 2 : 3;
+  return 0;
+}
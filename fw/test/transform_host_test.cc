@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include <vector>
+
+#include "host_board.h"
+
+namespace testing {
+
+struct Point {
+  int16_t len;
+  int16_t angle;
+  bool pen;
+};
+
+// Points of `moves` after `transform`.
+std::vector<Point> Transform(const std::vector<Point>& moves,
+                             const ImageTransform& transform) {
+  std::vector<DataPoint> entries;
+  for (const Point& m : moves) {
+    DataPoint p;
+    p.len = m.len;
+    p.angle = m.angle;
+    p.pen = m.pen;
+    entries.push_back(p);
+  }
+  Image image{static_cast<uint16_t>(entries.size()), entries.data()};
+  Transformed source(ImageReader(&image), transform);
+  std::vector<Point> points;
+  DataPoint p;
+  while (source.Next(&p)) {
+    points.push_back({p.len, static_cast<int16_t>(p.angle), p.pen != 0});
+  }
+  return points;
+}
+
+TEST(TransformTest, Identity) {
+  std::vector<Point> moves = {
+    {100, 0, true}, {-32767, -16384, false}, {32767, 16383, true}};
+  std::vector<Point> points = Transform(moves, {});
+  ASSERT_EQ(points.size(), moves.size());
+  for (size_t i = 0; i < moves.size(); ++i) {
+    EXPECT_EQ(points[i].len, moves[i].len) << i;
+    EXPECT_EQ(points[i].angle, moves[i].angle) << i;
+    EXPECT_EQ(points[i].pen, moves[i].pen) << i;
+  }
+}
+
+// The rounding of each length is carried to the next one, so the total
+// length is the scaled total rounded, however many points there are.
+TEST(TransformTest, ScaleCarry) {
+  for (uint16_t scale : {11585, 23170, 12345}) {
+    std::vector<Point> moves;
+    int64_t total = 0;
+    for (int i = 0; i < 20000; ++i) {
+      int16_t len = i % 13 == 0 ? -(i % 17) : 7 + i % 5;
+      moves.push_back({len, static_cast<int16_t>(i % 11 - 5), i % 3 != 0});
+      total += len;
+    }
+    std::vector<Point> points = Transform(moves, {.scale = scale});
+    ASSERT_EQ(points.size(), moves.size());
+    int64_t scaled = 0;
+    for (size_t i = 0; i < points.size(); ++i) {
+      scaled += points[i].len;
+      EXPECT_EQ(points[i].angle, moves[i].angle);
+      EXPECT_EQ(points[i].pen, moves[i].pen);
+      // Each point is off by less than one step.
+      double exact = moves[i].len * (scale / 16384.0);
+      EXPECT_LT(fabs(points[i].len - exact), 1) << scale << " " << i;
+    }
+    EXPECT_EQ(scaled, llround(total * (scale / 16384.0))) << scale;
+  }
+}
+
+TEST(TransformTest, Mirror) {
+  std::vector<Point> moves = {{100, 300, true}, {-50, -1565, false}};
+  std::vector<Point> points = Transform(moves, {.mirror = true});
+  ASSERT_EQ(points.size(), 2u);
+  EXPECT_EQ(points[0].len, 100);
+  EXPECT_EQ(points[0].angle, -300);
+  EXPECT_TRUE(points[0].pen);
+  EXPECT_EQ(points[1].len, -50);
+  EXPECT_EQ(points[1].angle, 1565);
+  EXPECT_FALSE(points[1].pen);
+}
+
+// The smallest angle has no mirror image in DataPoint, so its rotation is
+// split.
+TEST(TransformTest, MirrorSmallestAngle) {
+  std::vector<Point> points =
+      Transform({{100, -16384, true}, {5, 7, true}}, {.mirror = true});
+  ASSERT_EQ(points.size(), 3u);
+  EXPECT_EQ(points[0].len, 0);
+  EXPECT_EQ(points[0].angle, 16383);
+  EXPECT_EQ(points[1].len, 100);
+  EXPECT_EQ(points[1].angle, 1);
+  EXPECT_EQ(points[2].len, 5);
+  EXPECT_EQ(points[2].angle, -7);
+  for (const Point& p : points) EXPECT_TRUE(p.pen);
+}
+
+// Only the first point turns to the heading.
+TEST(TransformTest, Heading) {
+  std::vector<Point> moves = {{100, 300, true}, {100, 300, true}};
+  std::vector<Point> points = Transform(moves, {.heading = -3130});
+  ASSERT_EQ(points.size(), 2u);
+  EXPECT_EQ(points[0].angle, 300 - 3130);
+  EXPECT_EQ(points[1].angle, 300);
+
+  // Mirrored before turning.
+  points = Transform(moves, {.heading = 3130, .mirror = true});
+  ASSERT_EQ(points.size(), 2u);
+  EXPECT_EQ(points[0].angle, -300 + 3130);
+  EXPECT_EQ(points[1].angle, -300);
+
+  points = Transform({{10, 16000, false}}, {.heading = 1000});
+  ASSERT_EQ(points.size(), 2u);
+  EXPECT_EQ(points[0].len, 0);
+  EXPECT_EQ(points[0].angle, 16383);
+  EXPECT_EQ(points[1].len, 10);
+  EXPECT_EQ(points[1].angle, 17000 - 16383);
+}
+
+// Lengths scaled out of the range of DataPoint are split into points moving
+// forward without rotation.
+TEST(TransformTest, LongLength) {
+  std::vector<Point> points = Transform(
+      {{30000, 200, true}, {-32767, 0, false}, {3, 1, true}},
+      {.scale = 3 * ImageTransform::kUnitScale});
+  ASSERT_EQ(points.size(), 7u);
+  const Point expected[] = {
+    {32767, 200, true}, {32767, 0, true}, {24466, 0, true},
+    {-32767, 0, false}, {-32767, 0, false}, {-32767, 0, false},
+    {9, 1, true},
+  };
+  for (size_t i = 0; i < std::size(expected); ++i) {
+    EXPECT_EQ(points[i].len, expected[i].len) << i;
+    EXPECT_EQ(points[i].angle, expected[i].angle) << i;
+    EXPECT_EQ(points[i].pen, expected[i].pen) << i;
+  }
+}
+
+}  // namespace testing
@@ -24,10 +24,24 @@ xcb_visualtype_t *Window::find_visual(xcb_connection_t *c,
 }
 
 Window::Window(double _xmin, double _xmax, double _ymin, double _ymax,
-               double _brdx, double _brdy)
-    : xmin{_xmin}, xmax{_xmax}, ymin{_ymin}, ymax{_ymax}, brdx{_brdx}, brdy{_brdy} {
+               double _brdx, double _brdy, bool offscreen)
+    : xmin{_xmin}, xmax{_xmax}, ymin{_ymin}, ymax{_ymax}, brdx{_brdx}, brdy{_brdy},
+      c{nullptr}, surface{nullptr}, cr{nullptr}, backing{nullptr},
+      backing_cr{nullptr} {
+  draw = [](cairo_t *) {};
+  overlay = [](cairo_t *) {};
+  ratio = (xmax - xmin + 2 * brdx)/(ymax - ymin + 2 * brdy);
+  width = 1000;
+  height = width/ratio;
+
+  if (offscreen || getenv("DISPLAY") == NULL) return;
   c = xcb_connect(NULL, NULL);
-  assert(!xcb_connection_has_error(c));
+  if (xcb_connection_has_error(c)) {
+    cerr << "Cannot connect to X, rendering offscreen." << endl;
+    xcb_disconnect(c);
+    c = nullptr;
+    return;
+  }
 
   xcb_screen_t *screen = xcb_setup_roots_iterator(xcb_get_setup(c)).data;
   xcb_window_t window = xcb_generate_id(c);
@@ -38,14 +52,6 @@ Window::Window(double _xmin, double _xmax, double _ymin, double _ymax,
                             XCB_EVENT_MASK_EXPOSURE | XCB_EVENT_MASK_KEY_PRESS |
                             XCB_EVENT_MASK_STRUCTURE_NOTIFY};
 
-  //width = (xmax - xmin + 2 * brdx);
-  //height = (ymax - ymin + 2 * brdy);
-
-  ratio = (xmax - xmin + 2 * brdx)/(ymax - ymin + 2 * brdy);
-
-  width = 1000;
-  height = width/ratio;
-
   xcb_create_window(c, XCB_COPY_FROM_PARENT, window, screen->root, 20, 20,
                     width, height, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
                     screen->root_visual, mask, values);
@@ -56,37 +62,79 @@ Window::Window(double _xmin, double _xmax, double _ymin, double _ymax,
   assert(visual);
   surface = cairo_xcb_surface_create(c, window, visual, width, height);
   cr = cairo_create(surface);
+  createBacking();
   xcb_flush(c);
-  draw = [](cairo_t *) {};
 }
 
 Window::~Window() {
+  if (offscreen()) return;
+  destroyBacking();
   cairo_destroy(cr);
   cairo_surface_finish(surface);
   cairo_surface_destroy(surface);
   xcb_disconnect(c);
 }
 
-void Window::redraw() {
-  cairo_save(cr);
-  cairo_set_source_rgb(cr, 255, 255, 255);
-  cairo_paint(cr);
+void Window::createBacking() {
+  backing = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+  backing_cr = cairo_create(backing);
+  renderBacking();
+}
+
+void Window::destroyBacking() {
+  cairo_destroy(backing_cr);
+  cairo_surface_destroy(backing);
+}
 
+// Maps the drawing to the window.
+void Window::transform(cairo_t *ctx) {
   double dx = xmax - xmin + 2 * brdx, dy = ymax - ymin + 2 * brdy;
   double sx = (double)width / dx, sy = (double)height / dy;
-  cairo_translate(cr, brdx * sx, brdy * sy);
-  cairo_scale(cr, sx, sy);
-  cairo_translate(cr, 0, ymax-ymin);
-  cairo_scale(cr, 1, -1);
-  cairo_translate(cr, -xmin, -ymin);
+  cairo_translate(ctx, brdx * sx, brdy * sy);
+  cairo_scale(ctx, sx, sy);
+  cairo_translate(ctx, 0, ymax-ymin);
+  cairo_scale(ctx, 1, -1);
+  cairo_translate(ctx, -xmin, -ymin);
+}
+
+// Renders `draw` into the backing image, on a white background.
+void Window::renderBacking() {
+  cairo_save(backing_cr);
+  cairo_set_source_rgb(backing_cr, 1, 1, 1);
+  cairo_paint(backing_cr);
+  cairo_restore(backing_cr);
+  append(draw);
+}
 
-  draw(cr);
+void Window::redraw() {
+  if (offscreen()) return;
+  renderBacking();
+  present();
+}
+
+void Window::append(const DrawFunction &f) {
+  if (offscreen()) return;
+  cairo_save(backing_cr);
+  transform(backing_cr);
+  f(backing_cr);
+  cairo_restore(backing_cr);
+}
+
+void Window::present() {
+  if (offscreen()) return;
+  cairo_surface_flush(backing);
+  cairo_save(cr);
+  cairo_set_source_surface(cr, backing, 0, 0);
+  cairo_paint(cr);
+  transform(cr);
+  overlay(cr);
   cairo_restore(cr);
   cairo_surface_flush(surface);
   xcb_flush(c);
 }
 
 void Window::show(bool wait) {
+  if (offscreen()) return;
   xcb_generic_event_t *event;
   while ((event = wait ? xcb_wait_for_event(c) : xcb_poll_for_event(c))) {
     switch (event->response_type & ~0x80) {
@@ -100,7 +148,9 @@ void Window::show(bool wait) {
           width=height*ratio;
         
         cairo_xcb_surface_set_size(surface, width, height);
-        redraw();
+        destroyBacking();
+        createBacking();
+        present();
         break;
       }
 
@@ -120,7 +170,7 @@ void Window::show(bool wait) {
          */
         if (((xcb_expose_event_t *)event)->count != 0) break;
 
-        redraw();
+        present();
         break;
     }
     free(event);
@@ -128,16 +178,24 @@ void Window::show(bool wait) {
   }
 }
 
-void Window::savePDF(const char *fname, double pts) {
-  double dx = xmax - xmin + 2 * brdx, dy = ymax - ymin + 2 * brdy;
-  auto surf = cairo_pdf_surface_create(fname, pts * dx, pts * dy);
-  auto ctx = cairo_create(surf);
-  cairo_translate(ctx, pts * brdx, pts * brdy);
-  cairo_scale(ctx, pts, pts);
+// Draws with `scale` units of the surface per unit of the drawing.
+void Window::drawTo(cairo_t *ctx, double scale) {
+  cairo_save(ctx);
+  cairo_translate(ctx, scale * brdx, scale * brdy);
+  cairo_scale(ctx, scale, scale);
   cairo_translate(ctx, 0, ymax-ymin);
   cairo_scale(ctx, 1, -1);
   cairo_translate(ctx, -xmin, -ymin);
   draw(ctx);
+  overlay(ctx);
+  cairo_restore(ctx);
+}
+
+void Window::savePDF(const char *fname, double pts) {
+  double dx = xmax - xmin + 2 * brdx, dy = ymax - ymin + 2 * brdy;
+  auto surf = cairo_pdf_surface_create(fname, pts * dx, pts * dy);
+  auto ctx = cairo_create(surf);
+  drawTo(ctx, pts);
   cairo_show_page(ctx);
   cairo_surface_flush(surf);
   cairo_destroy(ctx);
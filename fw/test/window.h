@@ -16,6 +16,15 @@
 
 using DrawFunction = std::function<void(cairo_t *)>;
 
+// Window showing a drawing, which can also be saved to PDF.
+//
+// Without an X display (DISPLAY is unset or the connection fails), or if
+// `offscreen` is set, there is no window: redraw() and show() do nothing and
+// the drawing is only rendered when it is saved.
+//
+// The window shows a backing image with `overlay` drawn on top. redraw()
+// renders the whole drawing into the backing image; append() adds to it, so
+// growing drawings can be updated without drawing everything again.
 struct Window {
   int width, height;
   double xmin, xmax, ymin, ymax, brdx, brdy; // size + border
@@ -24,19 +33,31 @@ struct Window {
   xcb_connection_t *c;
   cairo_surface_t *surface;
   cairo_t *cr;
+  cairo_surface_t *backing;
+  cairo_t *backing_cr;
 
   Window(double _xmin = 0, double _xmax = 1, double _ymin = 0, double _ymax = 1,
-         double _brdx = 0.3, double _brdy = 0.3);
+         double _brdx = 0.3, double _brdy = 0.3, bool offscreen = false);
   ~Window();
 
   DrawFunction draw; // called when drawing
+  DrawFunction overlay; // drawn over `draw`, not kept in the backing image
 
   void redraw();
+  void append(const DrawFunction &f); // draws into the backing image
+  void present(); // shows the backing image and the overlay
   void show(bool wait);
   void savePDF(const char *fname, double pts = 500);
 
+  bool offscreen() const { return c == nullptr; }
+
   private:
   xcb_visualtype_t *find_visual(xcb_connection_t *c, xcb_visualid_t visual);
+  void drawTo(cairo_t *ctx, double scale);
+  void transform(cairo_t *ctx);
+  void createBacking();
+  void renderBacking();
+  void destroyBacking();
 };
 
 #endif
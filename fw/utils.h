@@ -79,4 +79,18 @@ concept IsTimer = requires {
   { T::GetTime() } -> std::same_as<uint16_t>;
 };
 
+// Optional timer extension: 32-bit time, which does not wrap between reads.
+template <typename T>
+concept HasTime32 = IsTimer<T> && requires {
+  { T::GetTime32() } -> std::same_as<uint32_t>;
+};
+
+// Optional timer extension: low-power wait. Idle() sleeps until an interrupt,
+// at the latest kMaxIdle ticks.
+template <typename T>
+concept HasIdle = IsTimer<T> && requires {
+  { T::Idle() } -> std::same_as<void>;
+  { T::kMaxIdle } -> std::convertible_to<uint32_t>;
+};
+
 #endif  // UTILS_H_
@@ -0,0 +1,87 @@
+
+#ifndef IMAGE_Example_H_
+#define IMAGE_Example_H_
+#include <avr/pgmspace.h>
+#include "../fw/driver.h"
+
+const DataPoint kExampleData[] IMAGE_DATA = {
+  { 671, -450, 0 },
+  { 477, -2380, 1 },
+  { 153, 732, 1 },
+  { 173, 870, 1 },
+  { 464, 850, 1 },
+  { 544, 675, 1 },
+  { 148, 860, 1 },
+  { -176, -2253, 1 },
+  { -411, 709, 1 },
+  { -476, 686, 1 },
+  { -154, 734, 1 },
+  { -170, 877, 1 },
+  { -502, 895, 1 },
+  { -502, 651, 1 },
+  { -149, 831, 1 },
+  { -175, 881, 1 },
+  { -476, 794, 1 },
+  { -1104, -1264, 0 },
+  { -475, 1864, 1 },
+  { 153, -2397, 1 },
+  { 170, 874, 1 },
+  { 502, 897, 1 },
+  { 502, 650, 1 },
+  { 149, 833, 1 },
+  { 148, 819, 1 },
+  { 502, 829, 1 },
+  { 521, 561, 1 },
+  { 181, 742, 1 },
+  { 171, 930, 1 },
+  { 502, 899, 1 },
+  { 502, 649, 1 },
+  { 148, 834, 1 },
+  { 176, -5387, 1 },
+  { 476, 799, 1 },
+  { -1054, 2651, 0 },
+  { -984, 1453, 1 },
+  { -462, 391, 1 },
+  { -508, 343, 1 },
+  { -416, -5965, 1 },
+  { -497, 303, 1 },
+  { -499, 275, 1 },
+  { 602, -2904, 1 },
+  { 789, 2915, 1 },
+  { 886, -442, 1 },
+  { 973, -436, 1 },
+  { 938, -558, 1 },
+  { -387, -414, 1 },
+  { -673, 285, 1 },
+  { -462, 336, 1 },
+  { -509, 344, 1 },
+  { -415, 296, 1 },
+  { -497, 302, 1 },
+  { -499, 277, 1 },
+  { -602, 224, 1 },
+  { -876, 2894, 1 },
+  { 915, -3606, 1 },
+  { 857, -403, 1 },
+  { 938, -535, 1 },
+  { 656, 355, 0 },
+  { 697, 2076, 1 },
+  { 837, 354, 1 },
+  { 831, 383, 1 },
+  { -852, -2740, 1 },
+  { -701, 358, 1 },
+  { -1002, 397, 1 },
+  { -832, 423, 1 },
+  { -1029, 430, 1 },
+  { -697, 395, 1 },
+  { 837, -2776, 1 },
+  { 831, 381, 1 },
+  { 1025, 433, 1 },
+  { 695, 397, 1 },
+  { 998, 395, 1 },
+  { 834, 422, 1 },
+  { -864, -2738, 1 },
+};
+
+const Image kExample IMAGE_DATA = { 75, kExampleData };
+
+#endif  // IMAGE_Example_H_
@@ -3,11 +3,14 @@
 #include <stdlib.h>
 #include <tinyxml2.h>
 
+#include <algorithm>
 #include <numeric>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#include "../fw/opcodes.h"
+#include "motif.h"
 #include "parser.h"
 #include "point.h"
 
@@ -49,7 +52,7 @@ struct State {
   bool fwd = true;
 };
 
-void UpdateState(const Point& dst, State* state, int16_t* len, int16_t* angle) {
+void UpdateState(const Point& dst, State* state, int32_t* len, int16_t* angle) {
   constexpr double kWheelDiameter = 50.5;                    // mm
   constexpr double kWheelDistance = 77.2;                    // mm
   constexpr double kStepLen = M_PI * kWheelDiameter / 4096;  // mm / step
@@ -61,7 +64,7 @@ void UpdateState(const Point& dst, State* state, int16_t* len, int16_t* angle) {
       kStepAngle;  // never perform less than this many steps on a motor.
 
   Point u = dst - state->p;
-  *len = static_cast<uint16_t>(u.Len() / kStepLen + 0.5);
+  *len = static_cast<int32_t>(u.Len() / kStepLen + 0.5);
   if (fabs(*len) < kMinSteps) {
     *len = 0;
     *angle = 0;
@@ -109,7 +112,7 @@ int main(int argc, char** argv) {
   if (argc < 2) {
     fprintf(stderr,
             "Usage: %s <input.svg> [-elimShort <double>] [-smooth <double>] "
-            "[-join <double>] [-landscape] [-a4 | -a2 | -a1]]\n",
+            "[-join <double>] [-landscape] [-a4 | -a2 | -a1] [-noMotifs]]\n",
             argv[0]);
     return 1;
   }
@@ -118,6 +121,7 @@ int main(int argc, char** argv) {
 
   Parser parser(argv[1]);
   bool landscape = false;
+  bool motifs = true;
   int paper = 3;
 
   for (int i = 2; i < argc; i++)
@@ -135,6 +139,8 @@ int main(int argc, char** argv) {
       nameroot = argv[i];
     } else if (!strcmp(argv[i], "-landscape")) {
       landscape = true;
+    } else if (!strcmp(argv[i], "-noMotifs")) {
+      motifs = false;
     } else if (!strcmp(argv[i], "-a4")) {
       paper = 4;
     } else if (!strcmp(argv[i], "-a2")) {
@@ -212,27 +218,57 @@ int main(int argc, char** argv) {
       "#include <avr/pgmspace.h>\n"
       "#include \"../fw/driver.h\"\n"
       "\n"
-      "const DataPoint k%sData[] PROGMEM = {\n", nameroot, nameroot, nameroot);
+      "const DataPoint k%sData[] IMAGE_DATA = {\n", nameroot, nameroot, nameroot);
+  std::vector<Move> moves;
   {
     std::vector<std::pair<Point, bool>> filtered_points;
     for (const auto& raw_p : raw_points) {
       uint8_t pen = raw_p.second ? 1 : 0;
-      int16_t len;
+      int32_t len;
       int16_t angle;
       UpdateState((raw_p.first + offset) * scale, &s, &len, &angle);
       if (len != 0 || angle != 0) {
-        printf("  { %d, %d, %d },\n", len, angle, pen);
+        // Lengths beyond DataPoint::len, or equal to kOpcodeMarker, continue
+        // in further moves without rotation.
+        do {
+          constexpr int32_t kMaxLen = -(kOpcodeMarker + 1);
+          int16_t part = std::clamp(len, -kMaxLen, kMaxLen);
+          moves.push_back({part, angle, pen != 0});
+          len -= part;
+          angle = 0;
+        } while (len != 0);
         filtered_points.push_back(raw_p);
       }
     }
     raw_points = std::move(filtered_points);
   }
 
+  // Repeated motifs are stored once and called.
+  std::vector<Move> entries = motifs ? CompressMotifs(moves) : moves;
+  std::vector<Move> stored;
+  for (const Move& m : entries) stored.push_back(StoredMove(m));
+  if (ExpandMotifs(stored) != moves) {
+    fprintf(stderr, "Motif compression failed\n");
+    return 1;
+  }
+  fprintf(stderr, "%zu moves, %zu entries\n", moves.size(), entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const Move& m = entries[i];
+    if (m.len != kOpcodeMarker) {
+      printf("  { %d, %d, %d },\n", m.len, m.angle, m.pen ? 1 : 0);
+      continue;
+    }
+    const Move& arg = entries[++i];
+    printf("  { %d, %d, 0 },  // %s\n", m.len, m.angle,
+           m.angle == kOpCall ? "call" : "repeat");
+    printf("  { %d, %d, 0 },\n", arg.len, arg.angle);
+  }
+
   printf(
       "};\n\n"
-      "const Image k%s PROGMEM = { %d, k%sData };\n\n"
+      "const Image k%s IMAGE_DATA = { %zu, k%sData };\n\n"
       "#endif  // IMAGE_%s_H_\n",
-      nameroot, raw_points.size(), nameroot, nameroot);
+      nameroot, entries.size(), nameroot, nameroot);
 
 #if DEBUG_SHOW
   {
@@ -0,0 +1,152 @@
+#include "motif.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "../fw/opcodes.h"
+
+namespace {
+
+// Longest call and highest call target the argument fields can hold. The
+// length is stored in the 15 bit angle of DataPoint.
+constexpr int kMaxCallLength = 0x3fff;
+constexpr int kMaxCallStart = 0x7fff;
+
+// Candidates checked for each position.
+constexpr int kMaxChain = 256;
+
+uint64_t Key(const std::vector<Move>& moves, int i, int len) {
+  uint64_t h = 0;
+  for (int k = 0; k < len; ++k) {
+    const Move& m = moves[i + k];
+    h = h * 1000003 + (static_cast<uint16_t>(m.len) << 17) +
+        (static_cast<uint16_t>(m.angle) << 1) + m.pen;
+  }
+  return h;
+}
+
+// Same layout as DataPoint (fw/driver.h).
+struct StoredPoint {
+  int16_t len;
+  int16_t angle : 15;
+  uint8_t pen : 1;
+};
+
+}  // namespace
+
+Move StoredMove(const Move& m) {
+  StoredPoint p;
+  p.len = m.len;
+  p.angle = m.angle;
+  p.pen = m.pen;
+  return {p.len, static_cast<int16_t>(p.angle), p.pen != 0};
+}
+
+std::vector<Move> CompressMotifs(const std::vector<Move>& moves,
+                                 int min_length) {
+  const int n = moves.size();
+  std::vector<Move> out;
+  // Output index of each move emitted as is, -1 if it is covered by a call.
+  std::vector<int> literal(n, -1);
+  // Earlier positions by the key of the `min_length` moves starting there.
+  std::unordered_map<uint64_t, std::vector<int>> chains;
+
+  int i = 0;
+  while (i < n) {
+    int best_len = 0;
+    int best_start = 0;
+    if (i + min_length <= n) {
+      auto it = chains.find(Key(moves, i, min_length));
+      if (it != chains.end()) {
+        const std::vector<int>& chain = it->second;
+        int checked = 0;
+        for (auto j = chain.rbegin(); j != chain.rend() && checked < kMaxChain;
+             ++j, ++checked) {
+          // The source has to be stored as is and not overlap position i.
+          int len = 0;
+          while (i + len < n && *j + len < i && len < kMaxCallLength &&
+                 literal[*j + len] >= 0 && moves[*j + len] == moves[i + len]) {
+            len++;
+          }
+          if (len > best_len && literal[*j] <= kMaxCallStart) {
+            best_len = len;
+            best_start = *j;
+          }
+        }
+      }
+    }
+
+    if (best_len < min_length) {
+      literal[i] = out.size();
+      out.push_back(moves[i]);
+      if (i + min_length <= n) {
+        chains[Key(moves, i, min_length)].push_back(i);
+      }
+      i++;
+      continue;
+    }
+
+    // Count the copies following directly.
+    int copies = 1;
+    while (i + (copies + 1) * best_len <= n &&
+           std::equal(moves.begin() + best_start,
+                      moves.begin() + best_start + best_len,
+                      moves.begin() + i + copies * best_len)) {
+      copies++;
+    }
+    copies = std::min(copies, 0x7fff);
+    if (copies > 1) {
+      out.push_back({kOpcodeMarker, kOpRepeat, false});
+      out.push_back({static_cast<int16_t>(copies), 0, false});
+    }
+    out.push_back({kOpcodeMarker, kOpCall, false});
+    out.push_back({static_cast<int16_t>(literal[best_start]),
+                   static_cast<int16_t>(best_len), false});
+    i += copies * best_len;
+  }
+  return out;
+}
+
+std::vector<Move> ExpandMotifs(const std::vector<Move>& entries) {
+  struct Call {
+    int ret, start, count, remaining, repeats;
+  };
+  std::vector<Move> moves;
+  std::vector<Call> calls;
+  int repeat = 1;
+  size_t next = 0;
+  auto fetch = [&]() {
+    if (!calls.empty()) calls.back().remaining--;
+    return entries[next++];
+  };
+  while (true) {
+    while (!calls.empty() && calls.back().remaining == 0) {
+      Call& c = calls.back();
+      if (--c.repeats > 0) {
+        c.remaining = c.count;
+        next = c.start;
+      } else {
+        next = c.ret;
+        calls.pop_back();
+      }
+    }
+    if (next >= entries.size()) break;
+    Move m = fetch();
+    if (m.len != kOpcodeMarker) {
+      moves.push_back(m);
+      continue;
+    }
+    Move arg = fetch();
+    if (m.angle == kOpRepeat) {
+      repeat = arg.len;
+    } else if (m.angle == kOpCall) {
+      if (calls.size() < kMaxCallDepth && repeat > 0) {
+        calls.push_back({static_cast<int>(next), arg.len, arg.angle, arg.angle,
+                         repeat});
+        next = arg.len;
+      }
+      repeat = 1;
+    }
+  }
+  return moves;
+}
@@ -0,0 +1,29 @@
+#ifndef __MOTIF_H__
+#define __MOTIF_H__
+
+#include <stdint.h>
+
+#include <vector>
+
+// Entry of the DataPoint array: a move, or an opcode or its argument (see
+// fw/opcodes.h).
+struct Move {
+  int16_t len;
+  int16_t angle;
+  bool pen;
+
+  bool operator==(const Move& m) const = default;
+};
+
+// `m` as read back from the image data, which has only 15 bits for the angle.
+Move StoredMove(const Move& m);
+
+// Replaces repeated sequences of at least `min_length` moves by calls of their
+// first occurrence, and directly repeated sequences by a repeated call.
+std::vector<Move> CompressMotifs(const std::vector<Move>& moves,
+                                 int min_length = 3);
+
+// Executes the opcodes, returns the moves.
+std::vector<Move> ExpandMotifs(const std::vector<Move>& entries);
+
+#endif
@@ -0,0 +1,110 @@
+// Streams an image to the robot over a serial port.
+//
+// Usage: stream <serial device> <image header generated by gendata>
+//
+// Start the tool, then select the streaming entry on the robot (the one after
+// the images and generators).
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../gendata/motif.h"
+#include "sender.h"
+
+namespace {
+
+uint64_t NowMs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+
+// Reads the "{ len, angle, pen }," lines of the DataPoint array and executes
+// the opcodes, the robot gets plain moves.
+bool ReadImage(const char* filename, std::vector<StreamPoint>* points) {
+  std::vector<Move> entries;
+  std::ifstream in(filename);
+  if (!in) return false;
+  std::string line;
+  while (std::getline(in, line)) {
+    int len;
+    int angle;
+    int pen;
+    if (sscanf(line.c_str(), " { %d , %d , %d }", &len, &angle, &pen) == 3) {
+      entries.push_back({static_cast<int16_t>(len),
+                         static_cast<int16_t>(angle), pen != 0});
+    }
+  }
+  for (const Move& m : ExpandMotifs(entries)) {
+    points->push_back({m.len, m.angle, m.pen});
+  }
+  return true;
+}
+
+int OpenSerial(const char* device) {
+  int fd = open(device, O_RDWR | O_NOCTTY);
+  if (fd < 0) return fd;
+  termios tio;
+  tcgetattr(fd, &tio);
+  cfmakeraw(&tio);
+  cfsetispeed(&tio, B115200);
+  cfsetospeed(&tio, B115200);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tcsetattr(fd, TCSANOW, &tio);
+  tcflush(fd, TCIOFLUSH);
+  return fd;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <serial device> <image header>\n", argv[0]);
+    return 1;
+  }
+  std::vector<StreamPoint> points;
+  if (!ReadImage(argv[2], &points) || points.empty()) {
+    fprintf(stderr, "No points in %s\n", argv[2]);
+    return 1;
+  }
+  int fd = OpenSerial(argv[1]);
+  if (fd < 0) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  StreamSender sender(std::move(points));
+  size_t reported = 0;
+  while (!sender.Done()) {
+    pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, 10) > 0) {
+      uint8_t buf[64];
+      ssize_t n = read(fd, buf, sizeof(buf));
+      if (n <= 0) {
+        perror("read");
+        return 1;
+      }
+      for (ssize_t i = 0; i < n; ++i) sender.Receive(buf[i]);
+    }
+    std::vector<uint8_t> frame = sender.Send(NowMs());
+    if (!frame.empty() && write(fd, frame.data(), frame.size()) < 0) {
+      perror("write");
+      return 1;
+    }
+    if (sender.Sent() != reported) {
+      reported = sender.Sent();
+      fprintf(stderr, "\r%zu points", reported);
+    }
+  }
+  fprintf(stderr, "\ndone, %u frames sent again\n", sender.Resends());
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,129 @@
+#ifndef STREAM_SENDER_H_
+#define STREAM_SENDER_H_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../fw/stream_protocol.h"
+
+struct StreamPoint {
+  int16_t len;
+  int16_t angle;
+  bool pen;
+};
+
+// Host side of the streaming protocol, see fw/stream_protocol.h. Independent
+// of the transport: bytes from the robot are passed to Receive() and frames
+// returned by Send() are written to the robot.
+class StreamSender {
+ public:
+  // frame_points: maximum points per frame
+  // timeout_ms: time after which an unanswered frame is sent again
+  StreamSender(std::vector<StreamPoint> points,
+               uint8_t frame_points = kStreamMaxFramePoints,
+               uint64_t timeout_ms = 1000)
+      : points_(std::move(points)),
+        frame_points_(std::min(frame_points, kStreamMaxFramePoints)),
+        timeout_ms_(timeout_ms) {}
+
+  // Handles a byte from the robot.
+  void Receive(uint8_t b) {
+    if (b == kStreamNak) {
+      // The same frame is sent again, a different one with the same sequence
+      // bit would be taken for a repeat if the robot stored the first one.
+      if (in_flight_) {
+        rejected_ = true;
+        free_ = 0;  // until the report following the answer
+      }
+    } else if ((b & ~kStreamAckSequence) == kStreamAck) {
+      bool sequence = b & kStreamAckSequence;
+      // Late answer to a frame which was sent again is ignored.
+      if (in_flight_ && sequence == sequence_) {
+        in_flight_ = false;
+        sequence_ = !sequence_;
+        next_ += frame_count_;
+        if (frame_count_ == 0) done_ = true;
+      }
+    } else if (b <= kStreamMaxFree) {
+      // The unacknowledged frame may not be stored yet.
+      size_t pending = in_flight_ ? frame_count_ : 0;
+      credits_ = b > pending ? b - pending : 0;
+      free_ = b;
+    }
+  }
+
+  // Returns the frame to send at time `now_ms`, empty if there is none.
+  std::vector<uint8_t> Send(uint64_t now_ms) {
+    if (done_) return {};
+    if (in_flight_) {
+      // A rejected frame is sent again as soon as it fits.
+      if (!(rejected_ && free_ >= frame_count_) &&
+          now_ms - sent_ms_ < timeout_ms_) {
+        return {};
+      }
+      rejected_ = false;
+      sent_ms_ = now_ms;
+      resends_++;
+      return frame_;
+    }
+    size_t remaining = points_.size() - next_;
+    size_t count = std::min<size_t>({remaining, frame_points_, credits_});
+    // The final empty frame needs no credits.
+    if (count == 0 && remaining != 0) return {};
+
+    uint8_t header = count | (sequence_ ? kStreamSequenceBit : 0);
+    frame_ = {kStreamFrameStart, header};
+    uint8_t sum = StreamChecksum(0, header);
+    for (size_t i = 0; i < count; ++i) {
+      const StreamPoint& p = points_[next_ + i];
+      uint8_t data[kStreamPointSize];
+      StreamEncodePoint(p.len, p.angle, p.pen, data);
+      for (uint8_t b : data) {
+        frame_.push_back(b);
+        sum = StreamChecksum(sum, b);
+      }
+    }
+    frame_.push_back(sum);
+    frame_count_ = count;
+    credits_ -= count;
+    in_flight_ = true;
+    sent_ms_ = now_ms;
+    return frame_;
+  }
+
+  // All points were sent and the end of the stream acknowledged.
+  bool Done() const {
+    return done_;
+  }
+
+  // Points acknowledged by the robot.
+  size_t Sent() const {
+    return next_;
+  }
+
+  // Frames sent again after a rejection or timeout.
+  unsigned Resends() const {
+    return resends_;
+  }
+
+ private:
+  std::vector<StreamPoint> points_;
+  const uint8_t frame_points_;
+  const uint64_t timeout_ms_;
+
+  size_t next_ = 0;  // first point not acknowledged
+  size_t credits_ = 0;  // points that can be sent
+  size_t free_ = 0;  // last reported free space
+  bool sequence_ = false;
+  bool in_flight_ = false;
+  bool rejected_ = false;  // in-flight frame was rejected
+  std::vector<uint8_t> frame_;  // last frame sent
+  size_t frame_count_ = 0;
+  uint64_t sent_ms_ = 0;
+  unsigned resends_ = 0;
+  bool done_ = false;
+};
+
+#endif  // STREAM_SENDER_H_